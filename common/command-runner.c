@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "command-runner.h"
+
+#include <string.h>
+
+#include <gio/gunixinputstream.h>
+
+#define COMMAND_RUNNER_READ_SIZE 65536
+
+/*
+ * Reads a command's stdout (or any pipe) to the end without blocking the
+ * main loop.  Every chunk goes to chunk_func and, split at newlines, to
+ * line_func as soon as it arrives; with keep_output the whole output is
+ * also collected, up to max_output bytes.  A timeout, going over
+ * max_output or cancellation stops the read and kills the command.
+ */
+typedef struct {
+	CommandRunnerOptions  options;
+	GSubprocess          *subprocess;
+	GInputStream         *stream;
+	GByteArray           *output;
+	GString              *line;
+	gsize                 max_output;
+	gint                  exit_status;
+
+	/* cancelled on timeout, error or by the caller's cancellable */
+	GCancellable         *cancellable;
+	GCancellable         *caller_cancellable;
+	gulong                cancelled_id;
+	guint                 timeout_id;
+	gboolean              timed_out;
+} CommandRun;
+
+static void command_run_read (GTask *task);
+
+static void
+command_run_free (gpointer data)
+{
+	CommandRun *run = data;
+
+	g_clear_object (&run->subprocess);
+	g_clear_object (&run->stream);
+	g_clear_object (&run->cancellable);
+	g_byte_array_unref (run->output);
+	g_string_free (run->line, TRUE);
+	g_free (run);
+}
+
+static void
+command_run_cancelled_cb (GCancellable *cancellable, gpointer data)
+{
+	CommandRun *run = data;
+
+	g_cancellable_cancel (run->cancellable);
+}
+
+static gboolean
+command_run_timeout_cb (gpointer data)
+{
+	CommandRun *run = data;
+
+	run->timeout_id = 0;
+	run->timed_out = TRUE;
+	g_cancellable_cancel (run->cancellable);
+
+	return FALSE;
+}
+
+/* Stops watching and hands the result to the caller.  @error is taken. */
+static void
+command_run_complete (GTask *task, GError *error)
+{
+	CommandRun *run = g_task_get_task_data (task);
+
+	if (run->timeout_id > 0) {
+		g_source_remove (run->timeout_id);
+		run->timeout_id = 0;
+	}
+
+	if (run->caller_cancellable) {
+		g_cancellable_disconnect (run->caller_cancellable, run->cancelled_id);
+		g_clear_object (&run->caller_cancellable);
+	}
+
+	if (error) {
+		if (run->subprocess)
+			g_subprocess_force_exit (run->subprocess);
+
+		if (run->timed_out && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_clear_error (&error);
+			g_set_error (&error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                         "Command did not finish in %u seconds", run->options.timeout);
+		}
+
+		g_task_return_error (task, error);
+	} else {
+		g_task_return_pointer (task,
+                               g_bytes_new (run->output->data, run->output->len),
+                               (GDestroyNotify) g_bytes_unref);
+	}
+
+	g_object_unref (task);
+}
+
+static gboolean
+command_run_take_chunk (CommandRun *run, const gchar *buf, gsize len, GError **error)
+{
+	const gchar *p = buf, *end = buf + len;
+
+	if (run->options.chunk_func &&
+        !run->options.chunk_func (buf, len, run->options.func_data)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Command output was rejected");
+		return FALSE;
+	}
+
+	if (run->options.keep_output) {
+		if (run->output->len + len > run->max_output) {
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                         "Command output exceeds %" G_GSIZE_FORMAT " bytes", run->max_output);
+			return FALSE;
+		}
+		g_byte_array_append (run->output, (const guint8 *) buf, len);
+	}
+
+	if (!run->options.line_func)
+		return TRUE;
+
+	while (p < end) {
+		const gchar *nl = memchr (p, '\n', end - p);
+
+		if (!nl) {
+			g_string_append_len (run->line, p, end - p);
+			break;
+		}
+
+		g_string_append_len (run->line, p, nl - p);
+		run->options.line_func (run->line->str, run->options.func_data);
+		g_string_truncate (run->line, 0);
+		p = nl + 1;
+	}
+
+	if (run->line->len > run->max_output) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                     "Command output line exceeds %" G_GSIZE_FORMAT " bytes", run->max_output);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+command_run_wait_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GError *error = NULL;
+	GTask *task = data;
+	CommandRun *run = g_task_get_task_data (task);
+
+	if (!g_subprocess_wait_finish (G_SUBPROCESS (source), res, &error)) {
+		command_run_complete (task, error);
+		return;
+	}
+
+	if (g_subprocess_get_if_exited (run->subprocess))
+		run->exit_status = g_subprocess_get_exit_status (run->subprocess);
+
+	command_run_complete (task, NULL);
+}
+
+static void
+command_run_read_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GBytes *bytes;
+	GError *error = NULL;
+	GTask *task = data;
+	CommandRun *run = g_task_get_task_data (task);
+
+	bytes = g_input_stream_read_bytes_finish (G_INPUT_STREAM (source), res, &error);
+	if (!bytes) {
+		command_run_complete (task, error);
+		return;
+	}
+
+	/* nothing is handed out once the run has been stopped */
+	if (g_cancellable_set_error_if_cancelled (run->cancellable, &error)) {
+		g_bytes_unref (bytes);
+		command_run_complete (task, error);
+		return;
+	}
+
+	if (g_bytes_get_size (bytes) == 0) {
+		g_bytes_unref (bytes);
+
+		/* a last line without its newline */
+		if (run->options.line_func && run->line->len > 0)
+			run->options.line_func (run->line->str, run->options.func_data);
+
+		if (run->subprocess)
+			g_subprocess_wait_async (run->subprocess, run->cancellable, command_run_wait_cb, task);
+		else
+			command_run_complete (task, NULL);
+		return;
+	}
+
+	if (!command_run_take_chunk (run, g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes), &error)) {
+		g_bytes_unref (bytes);
+		command_run_complete (task, error);
+		return;
+	}
+
+	g_bytes_unref (bytes);
+
+	command_run_read (task);
+}
+
+static void
+command_run_read (GTask *task)
+{
+	CommandRun *run = g_task_get_task_data (task);
+
+	g_input_stream_read_bytes_async (run->stream, COMMAND_RUNNER_READ_SIZE,
+                                     G_PRIORITY_DEFAULT, run->cancellable,
+                                     command_run_read_cb, task);
+}
+
+static GTask *
+command_run_new (const CommandRunnerOptions *options,
+                 GCancellable               *cancellable,
+                 GAsyncReadyCallback         callback,
+                 gpointer                    data)
+{
+	GTask *task;
+	CommandRun *run;
+
+	run = g_new0 (CommandRun, 1);
+	if (options)
+		run->options = *options;
+	run->options.env = NULL;
+	run->max_output = run->options.max_output ? run->options.max_output
+                                              : COMMAND_RUNNER_DEFAULT_MAX_OUTPUT;
+	run->exit_status = -1;
+	run->output = g_byte_array_new ();
+	run->line = g_string_new (NULL);
+	run->cancellable = g_cancellable_new ();
+
+	task = g_task_new (NULL, cancellable, callback, data);
+	g_task_set_task_data (task, run, command_run_free);
+
+	return task;
+}
+
+static void
+command_run_start (GTask *task, GInputStream *stream)
+{
+	GCancellable *cancellable = g_task_get_cancellable (task);
+	CommandRun *run = g_task_get_task_data (task);
+
+	run->stream = stream;
+
+	if (cancellable) {
+		run->caller_cancellable = g_object_ref (cancellable);
+		run->cancelled_id = g_cancellable_connect (cancellable,
+                                                   G_CALLBACK (command_run_cancelled_cb),
+                                                   run, NULL);
+	}
+
+	if (run->options.timeout > 0)
+		run->timeout_id = g_timeout_add_seconds (run->options.timeout, command_run_timeout_cb, run);
+
+	command_run_read (task);
+}
+
+/* Runs @argv (searched in PATH) and reads its stdout as described by
+ * @options.  command_runner_finish() gives the collected output and the
+ * exit status. */
+void
+command_runner_spawn_async (const gchar * const        *argv,
+                            const CommandRunnerOptions *options,
+                            GCancellable               *cancellable,
+                            GAsyncReadyCallback         callback,
+                            gpointer                    data)
+{
+	GTask *task;
+	GError *error = NULL;
+	GSubprocess *subprocess;
+	GSubprocessLauncher *launcher;
+	CommandRun *run;
+
+	task = command_run_new (options, cancellable, callback, data);
+	g_task_set_source_tag (task, command_runner_spawn_async);
+	run = g_task_get_task_data (task);
+
+	launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+	if (options && options->env) {
+		const gchar * const *e;
+		for (e = options->env; *e; e++) {
+			gchar **pair = g_strsplit (*e, "=", 2);
+			if (pair[0] && pair[1])
+				g_subprocess_launcher_setenv (launcher, pair[0], pair[1], TRUE);
+			g_strfreev (pair);
+		}
+	}
+
+	subprocess = g_subprocess_launcher_spawnv (launcher, argv, &error);
+	g_object_unref (launcher);
+
+	if (!subprocess) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	run->subprocess = subprocess;
+	command_run_start (task, g_object_ref (g_subprocess_get_stdout_pipe (subprocess)));
+}
+
+/* Like command_runner_spawn_async() for a pipe handed over by someone
+ * else, such as the system helper service.  @fd is closed when done and
+ * the exit status is always -1. */
+void
+command_runner_read_fd_async (gint                        fd,
+                              const CommandRunnerOptions *options,
+                              GCancellable               *cancellable,
+                              GAsyncReadyCallback         callback,
+                              gpointer                    data)
+{
+	GTask *task;
+
+	task = command_run_new (options, cancellable, callback, data);
+	g_task_set_source_tag (task, command_runner_read_fd_async);
+
+	command_run_start (task, g_unix_input_stream_new (fd, TRUE));
+}
+
+/* Returns the collected output (empty without keep_output), or NULL with
+ * @error set if the command could not be run, timed out, produced too
+ * much output or was cancelled. */
+GBytes *
+command_runner_finish (GAsyncResult  *res,
+                       gint          *exit_status,
+                       GError       **error)
+{
+	CommandRun *run;
+
+	g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+	run = g_task_get_task_data (G_TASK (res));
+	if (exit_status)
+		*exit_status = run->exit_status;
+
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
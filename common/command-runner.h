@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef _COMMAND_RUNNER_H_
+#define _COMMAND_RUNNER_H_
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define COMMAND_RUNNER_DEFAULT_MAX_OUTPUT (4 * 1024 * 1024)
+
+/* Returning FALSE from a chunk callback stops the command with
+ * G_IO_ERROR_INVALID_DATA. */
+typedef gboolean (*CommandRunnerChunkFunc) (const gchar *buf,
+                                            gsize        len,
+                                            gpointer     data);
+
+/* @line comes without its newline and is NUL-terminated. */
+typedef void     (*CommandRunnerLineFunc)  (const gchar *line,
+                                            gpointer     data);
+
+typedef struct {
+	guint                   timeout;     /* seconds, 0 for none */
+	gboolean                keep_output; /* collect stdout for _finish() */
+	gsize                   max_output;  /* 0 for COMMAND_RUNNER_DEFAULT_MAX_OUTPUT */
+	const gchar * const    *env;         /* extra "NAME=value" entries */
+	CommandRunnerChunkFunc  chunk_func;
+	CommandRunnerLineFunc   line_func;
+	gpointer                func_data;
+} CommandRunnerOptions;
+
+
+void     command_runner_spawn_async   (const gchar * const        *argv,
+                                       const CommandRunnerOptions *options,
+                                       GCancellable               *cancellable,
+                                       GAsyncReadyCallback         callback,
+                                       gpointer                    data);
+
+void     command_runner_read_fd_async (gint                        fd,
+                                       const CommandRunnerOptions *options,
+                                       GCancellable               *cancellable,
+                                       GAsyncReadyCallback         callback,
+                                       gpointer                    data);
+
+GBytes  *command_runner_finish        (GAsyncResult               *res,
+                                       gint                       *exit_status,
+                                       GError                    **error);
+
+G_END_DECLS
+
+#endif /* _COMMAND_RUNNER_H_ */
@@ -19,6 +19,7 @@
 
 
 #include "common.h"
+#include "command-runner.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -27,6 +28,7 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include <polkit/polkit.h>
 #include <json-c/json.h>
@@ -150,10 +152,143 @@ authenticate (const gchar *action_id)
 	return TRUE;
 }
 
+#define HELPER_SYNC_CALL_TIMEOUT 20000 /* msec, long enough to authenticate */
+
+static GDBusProxy *helper_proxy = NULL;
+static gboolean    helper_unavailable = FALSE;
+
+/* The system helper service is reached through one proxy for the life of
+ * the process.  Once it turns out not to be installed, callers go back to
+ * their pkexec helpers without asking the bus again. */
+static GDBusProxy *
+security_status_helper_get_proxy (void)
+{
+	if (helper_unavailable)
+		return NULL;
+
+	if (!helper_proxy) {
+		helper_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+                                                      G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                      G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                      NULL,
+                                                      GOOROOM_SECURITY_STATUS_HELPER_NAME,
+                                                      GOOROOM_SECURITY_STATUS_HELPER_PATH,
+                                                      GOOROOM_SECURITY_STATUS_HELPER_INTERFACE,
+                                                      NULL,
+                                                      NULL);
+		if (!helper_proxy)
+			helper_unavailable = TRUE;
+	}
+
+	return helper_proxy;
+}
+
+static GVariant *
+security_status_helper_reply (GVariant     *reply,
+                              GUnixFDList  *fd_list,
+                              GError       *call_error,
+                              gint         *out_fd,
+                              GError      **error)
+{
+	if (out_fd)
+		*out_fd = -1;
+
+	if (!reply) {
+		if (g_error_matches (call_error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN))
+			helper_unavailable = TRUE;
+		g_propagate_error (error, call_error);
+		return NULL;
+	}
+
+	if (out_fd && fd_list && g_variant_is_of_type (reply, G_VARIANT_TYPE ("(h)"))) {
+		gint32 handle;
+
+		g_variant_get (reply, "(h)", &handle);
+		*out_fd = g_unix_fd_list_get (fd_list, handle, NULL);
+	}
+
+	if (fd_list)
+		g_object_unref (fd_list);
+
+	return reply;
+}
+
+/* Calls @method on the system helper service, blocking for at most
+ * HELPER_SYNC_CALL_TIMEOUT.  Returns NULL if the call failed; for methods
+ * returning a file descriptor it is put in @out_fd. */
+GVariant *
+security_status_helper_call_sync (const gchar *method, GVariant *parameters, gint *out_fd)
+{
+	GVariant *reply;
+	GError *error = NULL;
+	GUnixFDList *fd_list = NULL;
+	GDBusProxy *proxy = security_status_helper_get_proxy ();
+
+	if (!proxy) {
+		if (parameters)
+			g_variant_unref (g_variant_ref_sink (parameters));
+		if (out_fd)
+			*out_fd = -1;
+		return NULL;
+	}
+
+	reply = g_dbus_proxy_call_with_unix_fd_list_sync (proxy, method, parameters,
+                                                      G_DBUS_CALL_FLAGS_NONE, HELPER_SYNC_CALL_TIMEOUT,
+                                                      NULL, &fd_list, NULL, &error);
+
+	return security_status_helper_reply (reply, fd_list, error, out_fd, NULL);
+}
+
+/* Asynchronous security_status_helper_call_sync(), failing after
+ * @timeout_msec (-1 for the default) or when @cancellable is cancelled.
+ * Returns FALSE, without calling @callback, when there is no helper
+ * service to call. */
+gboolean
+security_status_helper_call (const gchar         *method,
+                             GVariant            *parameters,
+                             gint                 timeout_msec,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             data)
+{
+	GDBusProxy *proxy = security_status_helper_get_proxy ();
+
+	if (!proxy) {
+		if (parameters)
+			g_variant_unref (g_variant_ref_sink (parameters));
+		return FALSE;
+	}
+
+	g_dbus_proxy_call_with_unix_fd_list (proxy, method, parameters,
+                                         G_DBUS_CALL_FLAGS_NONE, timeout_msec,
+                                         NULL, cancellable, callback, data);
+
+	return TRUE;
+}
+
+GVariant *
+security_status_helper_call_finish (GAsyncResult *res, gint *out_fd, GError **error)
+{
+	GVariant *reply;
+	GError *call_error = NULL;
+	GUnixFDList *fd_list = NULL;
+
+	reply = g_dbus_proxy_call_with_unix_fd_list_finish (helper_proxy, &fd_list, res, &call_error);
+
+	return security_status_helper_reply (reply, fd_list, call_error, out_fd, error);
+}
+
 void
 send_taking_measure_signal_to_self (void)
 {
 	gchar *pkexec, *cmdline;
+	GVariant *reply;
+
+	reply = security_status_helper_call_sync ("UpdateLogParserSeektime", NULL, NULL);
+	if (reply) {
+		g_variant_unref (reply);
+		return;
+	}
 
 	pkexec = g_find_program_in_path ("pkexec");
 	cmdline = g_strdup_printf ("%s %s", pkexec, GOOROOM_LOGPARSER_SEEKTIME_HELPER);
@@ -164,168 +299,1436 @@ send_taking_measure_signal_to_self (void)
 	g_free (cmdline);
 }
 
+static GDBusConnection *system_bus = NULL;
+static GDBusProxy      *agent_proxy = NULL;
+static guint            agent_watch_id = 0;
+
+/* One system bus connection is shared by the agent client and the
+ * systemd unit cache. */
+static GDBusConnection *
+system_bus_get (GError **error)
+{
+	if (!system_bus)
+		system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
+
+	return system_bus;
+}
+
+static void
+agent_name_appeared_cb (GDBusConnection *connection,
+                        const gchar     *name,
+                        const gchar     *name_owner,
+                        gpointer         data)
+{
+	gchar *owner;
+
+	if (!agent_proxy)
+		return;
+
+	/* a new owner means the agent was restarted behind our back */
+	owner = g_dbus_proxy_get_name_owner (agent_proxy);
+	if (g_strcmp0 (owner, name_owner) != 0)
+		g_clear_object (&agent_proxy);
+	g_free (owner);
+}
+
+static void
+agent_name_vanished_cb (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         data)
+{
+	g_clear_object (&agent_proxy);
+}
+
+/* The agent is reached through one system bus connection and one proxy
+ * for the life of the process.  The proxy is dropped when the agent goes
+ * away or restarts and is created again on the next call. */
+static GDBusProxy *
+agent_get_proxy (GError **error)
+{
+	GDBusConnection *bus = system_bus_get (error);
+
+	if (!bus)
+		return NULL;
+
+	if (agent_watch_id == 0) {
+		agent_watch_id = g_bus_watch_name_on_connection (bus,
+                                                         GOOROOM_AGENT_NAME,
+                                                         G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                         agent_name_appeared_cb,
+                                                         agent_name_vanished_cb,
+                                                         NULL, NULL);
+	}
+
+	if (!agent_proxy) {
+		agent_proxy = g_dbus_proxy_new_sync (bus,
+                                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                             G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                             NULL,
+                                             GOOROOM_AGENT_NAME,
+                                             GOOROOM_AGENT_PATH,
+                                             GOOROOM_AGENT_INTERFACE,
+                                             NULL,
+                                             error);
+	}
+
+	return agent_proxy;
+}
+
+static gchar *
+agent_task_request (const gchar *module, const gchar *task, json_object *in)
+{
+	gchar *request;
+	json_object *root_obj, *module_obj, *task_obj;
+
+	task_obj = json_object_new_object ();
+	json_object_object_add (task_obj, "task_name", json_object_new_string (task));
+	json_object_object_add (task_obj, "in", in ? json_object_get (in) : json_object_new_object ());
+
+	module_obj = json_object_new_object ();
+	json_object_object_add (module_obj, "module_name", json_object_new_string (module));
+	json_object_object_add (module_obj, "task", task_obj);
+
+	root_obj = json_object_new_object ();
+	json_object_object_add (root_obj, "module", module_obj);
+
+	request = g_strdup (json_object_to_json_string_ext (root_obj, JSON_C_TO_STRING_PLAIN));
+	json_object_put (root_obj);
+
+	return request;
+}
+
+/* Returns a new reference to module.task.out of a do_task reply. */
+static json_object *
+agent_task_reply (GVariant *reply, GError **error)
+{
+	GVariant *v = NULL;
+	json_object *root_obj, *out_obj = NULL;
+	enum json_tokener_error jerr = json_tokener_success;
+
+	g_variant_get (reply, "(v)", &v);
+	if (v && g_variant_is_of_type (v, G_VARIANT_TYPE_STRING)) {
+		root_obj = json_tokener_parse_verbose (g_variant_get_string (v, NULL), &jerr);
+		if (jerr == json_tokener_success) {
+			out_obj = JSON_OBJECT_GET (JSON_OBJECT_GET (JSON_OBJECT_GET (root_obj, "module"), "task"), "out");
+			if (out_obj)
+				json_object_get (out_obj);
+		}
+		json_object_put (root_obj);
+	}
+
+	if (v)
+		g_variant_unref (v);
+
+	if (!out_obj)
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Malformed reply from the agent");
+
+	return out_obj;
+}
+
+static void
+agent_do_task_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GVariant *reply;
+	GError *error = NULL;
+	json_object *out_obj = NULL;
+	GTask *task = data;
+
+	reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (reply) {
+		out_obj = agent_task_reply (reply, &error);
+		g_variant_unref (reply);
+	}
+
+	if (out_obj)
+		g_task_return_pointer (task, out_obj, (GDestroyNotify) json_object_put);
+	else
+		g_task_return_error (task, error);
+
+	g_object_unref (task);
+}
+
+/* Runs @task of @module on the agent with @in (may be NULL) as its input,
+ * giving up after @timeout_msec (-1 for the D-Bus default).
+ * agent_do_task_finish() hands back the task's "out" object. */
 void
-send_taking_measures_signal_to_agent (void)
+agent_do_task_async (const gchar         *module,
+                     const gchar         *task,
+                     json_object         *in,
+                     gint                 timeout_msec,
+                     GCancellable        *cancellable,
+                     GAsyncReadyCallback  callback,
+                     gpointer             data)
 {
-	GVariant   *variant;
+	gchar *request;
+	GTask *gtask;
 	GDBusProxy *proxy;
-	GError     *error = NULL;
-	gchar      *status = NULL;
+	GError *error = NULL;
+
+	gtask = g_task_new (NULL, cancellable, callback, data);
+	g_task_set_source_tag (gtask, agent_do_task_async);
+
+	proxy = agent_get_proxy (&error);
+	if (!proxy) {
+		g_task_return_error (gtask, error);
+		g_object_unref (gtask);
+		return;
+	}
+
+	request = agent_task_request (module, task, in);
+	g_dbus_proxy_call (proxy, "do_task",
+                       g_variant_new ("(s)", request),
+                       G_DBUS_CALL_FLAGS_NONE, timeout_msec,
+                       cancellable, agent_do_task_done_cb, gtask);
+	g_free (request);
+}
+
+json_object *
+agent_do_task_finish (GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+json_object *
+agent_do_task_sync (const gchar  *module,
+                    const gchar  *task,
+                    json_object  *in,
+                    gint          timeout_msec,
+                    GError      **error)
+{
+	gchar *request;
+	GVariant *reply;
+	GDBusProxy *proxy;
+	json_object *out_obj;
+
+	proxy = agent_get_proxy (error);
+	if (!proxy)
+		return NULL;
+
+	request = agent_task_request (module, task, in);
+	reply = g_dbus_proxy_call_sync (proxy, "do_task",
+                                    g_variant_new ("(s)", request),
+                                    G_DBUS_CALL_FLAGS_NONE, timeout_msec, NULL, error);
+	g_free (request);
+
+	if (!reply)
+		return NULL;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE,
-			NULL,
-			"kr.gooroom.agent",
-			"/kr/gooroom/agent",
-			"kr.gooroom.agent",
-			NULL,
-			&error);
+	out_obj = agent_task_reply (reply, error);
+	g_variant_unref (reply);
 
-	if (!proxy) goto done;
+	return out_obj;
+}
+
+static void
+send_taking_measures_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	json_object *out_obj = agent_do_task_finish (res, NULL);
+
+	if (out_obj)
+		json_object_put (out_obj);
+}
+
+void
+send_taking_measures_signal_to_agent (void)
+{
+	agent_do_task_async ("log", "clear_security_alarm", NULL,
+                         GOOROOM_AGENT_TASK_TIMEOUT, NULL,
+                         send_taking_measures_done_cb, NULL);
+}
+
+/*
+ * Requests made in the same main loop iteration share one parser run.
+ * The child is spawned from an idle callback, and until then a request
+ * joins the pending run, which then starts from the earliest seektime
+ * of its clients.  A NULL seektime lets the parser start from the
+ * beginning of the logs.  Clients are told the seektime actually used
+ * and drop the entries older than their own; the summary members are
+ * those of that seektime.
+ *
+ * A cancelled client gets no more output and is finished from an idle
+ * callback; a run left without clients stops its child.
+ */
+typedef struct {
+	SecurityLogParserFuncs  funcs;
+	gpointer                data;
+	GCancellable           *cancellable;
+	gulong                  cancelled_id;
+} LogParserClient;
+
+typedef struct {
+	gchar             *seektime;
+	GSList            *clients;
+	SecurityLogStream *stream;
+	GCancellable      *cancellable;
+	guint              spawn_id;
+	gboolean           reading;
+	gboolean           calling;
+} LogParserRun;
+
+static GSList *parser_runs = NULL;
+static guint   parser_prune_id = 0;
+
+/* Seektimes are written as "%Y%m%d-%H%M%S.%f" and compare as strings
+ * once the newline a seektime file may end with is stripped. */
+static gchar *
+seektime_normalize (const gchar *seektime)
+{
+	gchar *normalized;
+
+	if (!seektime)
+		return NULL;
+
+	normalized = g_strstrip (g_strdup (seektime));
+	if (*normalized == '\0') {
+		g_free (normalized);
+		return NULL;
+	}
+
+	return normalized;
+}
+
+static void
+log_parser_run_join (LogParserRun *run, gchar *seektime)
+{
+	if (run->seektime && (!seektime || strcmp (seektime, run->seektime) < 0)) {
+		g_free (run->seektime);
+		run->seektime = seektime;
+	} else {
+		g_free (seektime);
+	}
+}
+
+static gboolean
+log_parser_client_is_active (LogParserClient *client)
+{
+	return !g_cancellable_is_cancelled (client->cancellable);
+}
+
+static void
+log_parser_client_finish (LogParserClient *client, gboolean complete)
+{
+	complete = complete && log_parser_client_is_active (client);
+
+	if (client->cancellable) {
+		g_cancellable_disconnect (client->cancellable, client->cancelled_id);
+		g_object_unref (client->cancellable);
+	}
+
+	if (client->funcs.done_func)
+		client->funcs.done_func (complete, client->data);
+
+	g_free (client);
+}
+
+static void
+log_parser_run_entry_cb (const gchar *category, json_object *entry, gpointer data)
+{
+	GSList *l;
+	LogParserRun *run = data;
+
+	for (l = run->clients; l; l = l->next) {
+		LogParserClient *client = l->data;
+		if (client->funcs.entry_func && log_parser_client_is_active (client))
+			client->funcs.entry_func (category, entry, client->data);
+	}
+}
+
+static void
+log_parser_run_member_cb (const gchar *key, json_object *value, gpointer data)
+{
+	GSList *l;
+	LogParserRun *run = data;
+
+	for (l = run->clients; l; l = l->next) {
+		LogParserClient *client = l->data;
+		if (client->funcs.member_func && log_parser_client_is_active (client))
+			client->funcs.member_func (key, value, client->data);
+	}
+}
+
+static void
+log_parser_run_finish (LogParserRun *run, gboolean complete)
+{
+	GSList *l;
+
+	parser_runs = g_slist_remove (parser_runs, run);
 
-	const gchar *arg = "{\"module\":{\"module_name\":\"log\",\"task\":{\"task_name\":\"clear_security_alarm\",\"in\":{}}}}";
+	for (l = run->clients; l; l = l->next)
+		log_parser_client_finish (l->data, complete);
 
-	variant = g_dbus_proxy_call_sync (proxy, "do_task",
-				g_variant_new ("(s)", arg),
-				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	g_slist_free (run->clients);
+	if (run->stream)
+		security_log_stream_free (run->stream);
+	g_clear_object (&run->cancellable);
+	g_free (run->seektime);
+	g_free (run);
+}
+
+/* Finishes the cancelled clients.  A run without clients is dropped
+ * before it starts or, once running, has its read cancelled, which
+ * closes the pipe and kills the child.  The pkexec'd parser usually runs
+ * as root and survives the kill, but it gets SIGPIPE on its next write. */
+static gboolean
+log_parser_prune (gpointer data)
+{
+	GSList *l, *next;
+
+	parser_prune_id = 0;
+
+	for (l = parser_runs; l; l = next) {
+		GSList *c, *cnext;
+		LogParserRun *run = l->data;
+
+		next = l->next;
+
+		for (c = run->clients; c; c = cnext) {
+			LogParserClient *client = c->data;
+
+			cnext = c->next;
+			if (!log_parser_client_is_active (client)) {
+				run->clients = g_slist_delete_link (run->clients, c);
+				log_parser_client_finish (client, FALSE);
+			}
+		}
+
+		/* a run waiting for the helper service is pruned once it has
+		 * its output pipe */
+		if (run->clients || run->calling)
+			continue;
+
+		if (run->spawn_id > 0) {
+			g_source_remove (run->spawn_id);
+			run->spawn_id = 0;
+		}
 
-	if (variant) g_variant_unref (variant);
+		if (run->reading)
+			g_cancellable_cancel (run->cancellable);
 
-	g_object_unref (proxy);
+		log_parser_run_finish (run, FALSE);
+	}
+
+	return FALSE;
+}
+
+static void
+log_parser_cancelled_cb (GCancellable *cancellable, gpointer data)
+{
+	if (parser_prune_id == 0)
+		parser_prune_id = g_idle_add (log_parser_prune, NULL);
+}
+
+static gboolean
+log_parser_run_chunk_cb (const gchar *buf, gsize len, gpointer data)
+{
+	GSList *l;
+	LogParserRun *run = data;
+	gboolean ret = security_log_stream_feed (run->stream, buf, len);
+
+	/* let the clients show what has been parsed while the parser is
+	 * still writing */
+	for (l = run->clients; l; l = l->next) {
+		LogParserClient *client = l->data;
+		if (client->funcs.flush_func && log_parser_client_is_active (client))
+			client->funcs.flush_func (client->data);
+	}
+
+	return ret;
+}
 
-done:
-	if (error)
+static void
+log_parser_run_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GBytes *output;
+	GError *error = NULL;
+	LogParserRun *run = data;
+
+	output = command_runner_finish (res, NULL, &error);
+	if (!output) {
+		/* cancelled by log_parser_prune (), which already dropped the run */
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free (error);
+			return;
+		}
 		g_error_free (error);
+	} else {
+		g_bytes_unref (output);
+	}
+
+	run->reading = FALSE;
+	log_parser_run_finish (run, (output && security_log_stream_is_done (run->stream)));
+}
+
+static const CommandRunnerOptions *
+log_parser_run_options (LogParserRun *run, CommandRunnerOptions *options)
+{
+	memset (options, 0, sizeof (CommandRunnerOptions));
+	options->chunk_func = log_parser_run_chunk_cb;
+	options->func_data = run;
+
+	run->stream = security_log_stream_new (log_parser_run_entry_cb,
+                                           log_parser_run_member_cb, run);
+	run->cancellable = g_cancellable_new ();
+	run->reading = TRUE;
+
+	return options;
 }
 
 static void
-run_security_log_parser_async_done (GPid pid, gint status, gpointer data)
+log_parser_run_watch (LogParserRun *run, gint stdout_fd)
 {
-    g_spawn_close_pid (pid);
+	CommandRunnerOptions options;
+
+	command_runner_read_fd_async (stdout_fd, log_parser_run_options (run, &options),
+                                  run->cancellable, log_parser_run_done_cb, run);
 }
 
-gboolean
-run_security_log_parser_async (gchar *seektime, GIOFunc callback_func, gpointer data)
+static void
+log_parser_run_spawn (LogParserRun *run)
 {
-	GPid pid;
-	gboolean ret = FALSE;
-	gint stdout_fd;
-	gchar *pkexec, *cmdline = NULL;
+	gchar *pkexec;
 	const gchar *lang;
+	const gchar *argv[5] = { NULL, };
+	gint n = 0;
+	CommandRunnerOptions options;
+
+	pkexec = g_find_program_in_path ("pkexec");
+	if (!pkexec) {
+		log_parser_run_finish (run, FALSE);
+		return;
+	}
 
-    pkexec = g_find_program_in_path ("pkexec");
 	lang = g_getenv ("LANG");
 
-    if (seektime)
-        cmdline = g_strdup_printf ("%s %s %s %s", pkexec,
-                                   GOOROOM_SECURITY_LOGPARSER_WRAPPER, seektime, lang);
-    else
-        cmdline = g_strdup_printf ("%s %s %s", pkexec,
-                                   GOOROOM_SECURITY_LOGPARSER_WRAPPER, lang);
-
-	gchar **arr_cmd = g_strsplit (cmdline, " ", -1);
-
-	if (g_spawn_async_with_pipes (NULL,
-                                  arr_cmd,
-                                  NULL,
-                                  G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                  NULL,
-                                  NULL,
-                                  &pid,
-                                  NULL,
-                                  &stdout_fd,
-                                  NULL,
-                                  NULL)) {
-
-		g_child_watch_add (pid, (GChildWatchFunc)run_security_log_parser_async_done, data);
-
-		GIOChannel *io_channel = g_io_channel_unix_new (stdout_fd);
-		g_io_channel_set_flags (io_channel, G_IO_FLAG_NONBLOCK, NULL);
-		g_io_channel_set_encoding (io_channel, NULL, NULL);
-		g_io_channel_set_buffered (io_channel, FALSE);
-		g_io_channel_set_close_on_unref (io_channel, TRUE);
-		g_io_add_watch (io_channel, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP, callback_func, data);
-		g_io_channel_unref (io_channel);
-		ret = TRUE;
-	}
-
-	g_strfreev (arr_cmd);
+	argv[n++] = pkexec;
+	argv[n++] = GOOROOM_SECURITY_LOGPARSER_WRAPPER;
+	if (run->seektime)
+		argv[n++] = run->seektime;
+	argv[n++] = lang;
+
+	command_runner_spawn_async (argv, log_parser_run_options (run, &options),
+                                run->cancellable, log_parser_run_done_cb, run);
 
 	g_free (pkexec);
-	g_free (cmdline);
+}
 
-	return ret;
+static void
+log_parser_run_helper_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	gint stdout_fd = -1;
+	GVariant *reply;
+	LogParserRun *run = data;
+
+	run->calling = FALSE;
+
+	reply = security_status_helper_call_finish (res, &stdout_fd, NULL);
+	if (reply)
+		g_variant_unref (reply);
+
+	if (stdout_fd >= 0)
+		log_parser_run_watch (run, stdout_fd);
+	else
+		log_parser_run_spawn (run);
+
+	/* in case every request was cancelled during the call */
+	log_parser_cancelled_cb (NULL, NULL);
 }
 
 static gboolean
-get_object_path (gchar **object_path, const gchar *service_name)
+run_security_log_parser_async_spawn (gpointer data)
 {
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
+	GSList *l;
+	const gchar *lang;
+	LogParserRun *run = data;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			"/org/freedesktop/systemd1",
-			"org.freedesktop.systemd1.Manager",
-			NULL, &error);
+	run->spawn_id = 0;
 
-	if (!proxy) {
-		g_error_free (error);
-		return FALSE;
+	for (l = run->clients; l; l = l->next) {
+		LogParserClient *client = l->data;
+		if (client->funcs.start_func && log_parser_client_is_active (client))
+			client->funcs.start_func (run->seektime, client->data);
 	}
 
-	variant = g_dbus_proxy_call_sync (proxy, "GetUnit",
-			g_variant_new ("(s)", service_name),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	lang = g_getenv ("LANG");
 
-	if (!variant) {
-		g_error_free (error);
+	/* the system helper service saves a pkexec round trip per run */
+	if (security_status_helper_call ("RunLogParser",
+                                     g_variant_new ("(ss)",
+                                                    run->seektime ? run->seektime : "",
+                                                    lang ? lang : ""),
+                                     -1, NULL, log_parser_run_helper_cb, run)) {
+		run->calling = TRUE;
 	} else {
-		g_variant_get (variant, "(o)", object_path);
-		g_variant_unref (variant);
+		log_parser_run_spawn (run);
+	}
+
+	return FALSE;
+}
+
+/* Runs the log parser from @seektime, or from an earlier one when the
+ * run is shared, and reports its output through @funcs.  Returns FALSE if the parser cannot be run at all; otherwise
+ * done_func is eventually called, also when spawning fails later.
+ * Cancelling @cancellable drops the remaining output and calls done_func
+ * with @complete set to FALSE. */
+gboolean
+run_security_log_parser_async (const gchar                  *seektime,
+                               const SecurityLogParserFuncs *funcs,
+                               GCancellable                 *cancellable,
+                               gpointer                      data)
+{
+	GSList *l;
+	gchar *pkexec;
+	LogParserRun *run = NULL;
+	LogParserClient *client;
+
+	pkexec = g_find_program_in_path ("pkexec");
+	if (!pkexec && !security_status_helper_get_proxy ())
+		return FALSE;
+	g_free (pkexec);
+
+	if (g_cancellable_is_cancelled (cancellable))
+		return FALSE;
+
+	for (l = parser_runs; l; l = l->next) {
+		LogParserRun *pending = l->data;
+		if (pending->spawn_id > 0) {
+			run = pending;
+			log_parser_run_join (run, seektime_normalize (seektime));
+			break;
+		}
 	}
 
-	g_object_unref (proxy);
+	if (!run) {
+		run = g_new0 (LogParserRun, 1);
+		run->seektime = seektime_normalize (seektime);
+
+		parser_runs = g_slist_append (parser_runs, run);
+		run->spawn_id = g_idle_add (run_security_log_parser_async_spawn, run);
+	}
+
+	client = g_new0 (LogParserClient, 1);
+	client->funcs = *funcs;
+	client->data = data;
+	if (cancellable) {
+		client->cancellable = g_object_ref (cancellable);
+		client->cancelled_id = g_cancellable_connect (cancellable,
+                                                      G_CALLBACK (log_parser_cancelled_cb),
+                                                      NULL, NULL);
+	}
+	run->clients = g_slist_append (run->clients, client);
 
 	return TRUE;
 }
 
+/*
+ * The log parser prints some free-form text followed by
+ * "JSON-ANCHOR={...}".  The root object holds a few summary members and one
+ * array per category ("os_log", "exe_log", ...).  SecurityLogStream walks
+ * that output as it comes off the pipe: summary members are handed over as
+ * soon as they are complete and every element of a *_log array is parsed on
+ * its own with json_tokener_parse_ex(), so nothing ever holds the whole
+ * document.
+ *
+ * A wrapper with the framer installed writes GOOROOM_SECURITY_LOGPARSER_FRAME_MAGIC
+ * instead, followed by records of a little-endian 32-bit length and a
+ * serialized '(ysv)' GVariant: 'm' for a summary member, 'e' for a log
+ * entry and 'z' for the end of the document, whose boolean tells if the
+ * framer could read all of it.  Those are dispatched as soon as each
+ * record is complete, with no scanning at all.
+ */
+#define SECURITY_LOG_FRAME_MAX_SIZE    (16 * 1024 * 1024)
+
+enum {
+	STREAM_STATE_START,
+	STREAM_STATE_FRAME,
+	STREAM_STATE_ANCHOR,
+	STREAM_STATE_ROOT,
+	STREAM_STATE_KEY,
+	STREAM_STATE_KEY_STRING,
+	STREAM_STATE_COLON,
+	STREAM_STATE_VALUE,
+	STREAM_STATE_MEMBER,
+	STREAM_STATE_ARRAY,
+	STREAM_STATE_ELEMENT,
+	STREAM_STATE_SKIP,
+	STREAM_STATE_DONE,
+	STREAM_STATE_ERROR
+};
+
+struct _SecurityLogStream {
+	SecurityLogEntryFunc   entry_func;
+	SecurityLogMemberFunc  member_func;
+	gpointer               data;
+
+	gint                   state;
+	json_tokener          *tokener;
+
+	GString               *pending;
+	GString               *key;
+	GString               *value;
+
+	/* scanner state of the value being walked */
+	gint                   depth;
+	gboolean               in_string;
+	gboolean               escaped;
+};
+
+SecurityLogStream *
+security_log_stream_new (SecurityLogEntryFunc  entry_func,
+                         SecurityLogMemberFunc member_func,
+                         gpointer              data)
+{
+	SecurityLogStream *stream = g_new0 (SecurityLogStream, 1);
+
+	stream->entry_func = entry_func;
+	stream->member_func = member_func;
+	stream->data = data;
+	stream->state = STREAM_STATE_START;
+	stream->tokener = json_tokener_new ();
+	stream->pending = g_string_new (NULL);
+	stream->key = g_string_new (NULL);
+	stream->value = g_string_new (NULL);
+
+	return stream;
+}
+
+void
+security_log_stream_free (SecurityLogStream *stream)
+{
+	if (!stream)
+		return;
+
+	json_tokener_free (stream->tokener);
+	g_string_free (stream->pending, TRUE);
+	g_string_free (stream->key, TRUE);
+	g_string_free (stream->value, TRUE);
+	g_free (stream);
+}
+
 gboolean
-is_systemd_service_available (const gchar *service_name)
+security_log_stream_is_done (SecurityLogStream *stream)
 {
-	gboolean    ret = TRUE;
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
+	return (stream->state == STREAM_STATE_DONE);
+}
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			"/org/freedesktop/systemd1",
-			"org.freedesktop.systemd1.Manager",
-			NULL, &error);
+static void
+stream_begin_value (SecurityLogStream *stream, gint state)
+{
+	stream->state = state;
+	stream->depth = 0;
+	stream->in_string = FALSE;
+	stream->escaped = FALSE;
+}
 
-	if (!proxy) {
-		g_error_free (error);
-		return FALSE;
+/* Walks over one JSON value, keeping the nesting and string state across
+ * chunks.  Returns how many bytes of @buf belong to the value and sets
+ * @complete once its last byte has been seen.  Scalars end right before
+ * the ',' or closing bracket that follows them. */
+static gsize
+stream_scan_value (SecurityLogStream *stream, const gchar *buf, gsize len, gboolean *complete)
+{
+	gsize i;
+
+	*complete = FALSE;
+
+	for (i = 0; i < len; i++) {
+		gchar c = buf[i];
+
+		if (stream->in_string) {
+			if (stream->escaped) {
+				stream->escaped = FALSE;
+			} else if (c == '\\') {
+				stream->escaped = TRUE;
+			} else if (c == '"') {
+				stream->in_string = FALSE;
+				if (stream->depth == 0) {
+					*complete = TRUE;
+					return i + 1;
+				}
+			}
+			continue;
+		}
+
+		switch (c) {
+			case '"':
+				stream->in_string = TRUE;
+			break;
+
+			case '{':
+			case '[':
+				stream->depth++;
+			break;
+
+			case '}':
+			case ']':
+				if (stream->depth == 0) {
+					*complete = TRUE;
+					return i;
+				}
+				if (--stream->depth == 0) {
+					*complete = TRUE;
+					return i + 1;
+				}
+			break;
+
+			case ',':
+				if (stream->depth == 0) {
+					*complete = TRUE;
+					return i;
+				}
+			break;
+
+			default:
+			break;
+		}
 	}
 
-	variant = g_dbus_proxy_call_sync (proxy, "GetUnitFileState",
-			g_variant_new ("(s)", service_name),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	return len;
+}
 
-	if (!variant) {
-		g_error_free (error);
-		ret = FALSE;
+/* Reads the first bytes of the output to tell framed records from the
+ * plain parser output. */
+static void
+stream_check_magic (SecurityLogStream *stream, const gchar **p, const gchar *end)
+{
+	gsize magic_len = strlen (GOOROOM_SECURITY_LOGPARSER_FRAME_MAGIC);
+	gsize n = MIN (magic_len - stream->pending->len, (gsize)(end - *p));
+
+	g_string_append_len (stream->pending, *p, n);
+	*p += n;
+
+	if (memcmp (stream->pending->str, GOOROOM_SECURITY_LOGPARSER_FRAME_MAGIC, stream->pending->len) != 0) {
+		/* whatever was read stays pending for the anchor search */
+		stream->state = STREAM_STATE_ANCHOR;
+	} else if (stream->pending->len == magic_len) {
+		g_string_truncate (stream->pending, 0);
+		stream->state = STREAM_STATE_FRAME;
+	}
+}
+
+static json_object *
+stream_variant_to_json (GVariant *value)
+{
+	json_object *obj = NULL;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_VARIANT)) {
+		GVariant *child = g_variant_get_variant (value);
+		obj = stream_variant_to_json (child);
+		g_variant_unref (child);
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)) {
+		obj = json_object_new_boolean (g_variant_get_boolean (value));
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT64)) {
+		obj = json_object_new_int64 (g_variant_get_int64 (value));
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_DOUBLE)) {
+		obj = json_object_new_double (g_variant_get_double (value));
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+		obj = json_object_new_string (g_variant_get_string (value, NULL));
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_VARDICT)) {
+		GVariantIter iter;
+		const gchar *key;
+		GVariant *child;
+
+		obj = json_object_new_object ();
+		g_variant_iter_init (&iter, value);
+		while (g_variant_iter_next (&iter, "{&sv}", &key, &child)) {
+			json_object_object_add (obj, key, stream_variant_to_json (child));
+			g_variant_unref (child);
+		}
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE ("av"))) {
+		GVariantIter iter;
+		GVariant *child;
+
+		obj = json_object_new_array ();
+		g_variant_iter_init (&iter, value);
+		while (g_variant_iter_next (&iter, "v", &child)) {
+			json_object_array_add (obj, stream_variant_to_json (child));
+			g_variant_unref (child);
+		}
 	}
 
-	g_object_unref (proxy);
+	/* anything else, including the empty maybe, is null */
+	return obj;
+}
 
-	return ret;
+static void
+stream_dispatch_record (SecurityLogStream *stream, const gchar *buf, gsize len)
+{
+	guchar kind;
+	const gchar *key;
+	GBytes *bytes;
+	GVariant *record, *value;
+	json_object *obj;
+
+	/* copied, so the serialized data is suitably aligned */
+	bytes = g_bytes_new (buf, len);
+	record = g_variant_new_from_bytes (G_VARIANT_TYPE ("(ysv)"), bytes, FALSE);
+	g_bytes_unref (bytes);
+
+	g_variant_get (record, "(y&sv)", &kind, &key, &value);
+
+	switch (kind) {
+		case 'm':
+			obj = stream_variant_to_json (value);
+			if (stream->member_func)
+				stream->member_func (key, obj, stream->data);
+			json_object_put (obj);
+		break;
+
+		case 'e':
+			obj = stream_variant_to_json (value);
+			if (obj && stream->entry_func)
+				stream->entry_func (key, obj, stream->data);
+			json_object_put (obj);
+		break;
+
+		case 'z':
+			if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN) && !g_variant_get_boolean (value))
+				stream->state = STREAM_STATE_ERROR;
+			else
+				stream->state = STREAM_STATE_DONE;
+		break;
+
+		default:
+		break;
+	}
+
+	g_variant_unref (value);
+	g_variant_unref (record);
 }
 
+/* Buffers at most one incomplete record across chunks. */
+static void
+stream_read_frames (SecurityLogStream *stream, const gchar **p, const gchar *end)
+{
+	gsize offset = 0;
+	GString *pending = stream->pending;
+
+	g_string_append_len (pending, *p, end - *p);
+	*p = end;
+
+	while (stream->state == STREAM_STATE_FRAME && pending->len - offset >= 4) {
+		guint32 size;
+
+		memcpy (&size, pending->str + offset, 4);
+		size = GUINT32_FROM_LE (size);
+
+		if (size > SECURITY_LOG_FRAME_MAX_SIZE) {
+			stream->state = STREAM_STATE_ERROR;
+			break;
+		}
+
+		if (pending->len - offset - 4 < size)
+			break;
+
+		stream_dispatch_record (stream, pending->str + offset + 4, size);
+		offset += 4 + size;
+	}
+
+	g_string_erase (pending, 0, offset);
+}
+
+static gboolean
+stream_find_anchor (SecurityLogStream *stream, const gchar **p, const gchar *end)
+{
+	gchar *found;
+	gsize anchor_len = strlen (GOOROOM_SECURITY_LOGPARSER_JSON_ANCHOR);
+
+	g_string_append_len (stream->pending, *p, end - *p);
+
+	found = g_strstr_len (stream->pending->str, stream->pending->len,
+                          GOOROOM_SECURITY_LOGPARSER_JSON_ANCHOR);
+	if (found) {
+		/* the anchor was not in the previous tail, so everything after it
+		 * comes from the current chunk */
+		gsize rest = stream->pending->len - ((found - stream->pending->str) + anchor_len);
+		*p = end - rest;
+		g_string_truncate (stream->pending, 0);
+		return TRUE;
+	}
+
+	if (stream->pending->len >= anchor_len)
+		g_string_erase (stream->pending, 0, stream->pending->len - (anchor_len - 1));
+
+	*p = end;
+
+	return FALSE;
+}
+
+gboolean
+security_log_stream_feed (SecurityLogStream *stream, const gchar *buf, gsize len)
+{
+	gsize n;
+	gboolean complete;
+	const gchar *p = buf, *end = buf + len;
+
+	g_return_val_if_fail (stream != NULL, FALSE);
+
+	while (p < end) {
+		if (stream->state == STREAM_STATE_DONE)
+			return TRUE;
+
+		if (stream->state == STREAM_STATE_ERROR)
+			return FALSE;
+
+		switch (stream->state) {
+			case STREAM_STATE_START:
+				stream_check_magic (stream, &p, end);
+			break;
+
+			case STREAM_STATE_FRAME:
+				stream_read_frames (stream, &p, end);
+			break;
+
+			case STREAM_STATE_ANCHOR:
+				if (stream_find_anchor (stream, &p, end))
+					stream->state = STREAM_STATE_ROOT;
+			break;
+
+			case STREAM_STATE_ROOT:
+				if (g_ascii_isspace (*p)) {
+					p++;
+				} else if (*p == '{') {
+					stream->state = STREAM_STATE_KEY;
+					p++;
+				} else {
+					stream->state = STREAM_STATE_ERROR;
+				}
+			break;
+
+			case STREAM_STATE_KEY:
+				if (g_ascii_isspace (*p) || *p == ',') {
+					p++;
+				} else if (*p == '}') {
+					stream->state = STREAM_STATE_DONE;
+					p++;
+				} else if (*p == '"') {
+					g_string_truncate (stream->key, 0);
+					stream_begin_value (stream, STREAM_STATE_KEY_STRING);
+					p++;
+				} else {
+					stream->state = STREAM_STATE_ERROR;
+				}
+			break;
+
+			case STREAM_STATE_KEY_STRING:
+				if (stream->escaped) {
+					g_string_append_c (stream->key, *p);
+					stream->escaped = FALSE;
+				} else if (*p == '\\') {
+					stream->escaped = TRUE;
+				} else if (*p == '"') {
+					stream->state = STREAM_STATE_COLON;
+				} else {
+					g_string_append_c (stream->key, *p);
+				}
+				p++;
+			break;
+
+			case STREAM_STATE_COLON:
+				if (g_ascii_isspace (*p)) {
+					p++;
+				} else if (*p == ':') {
+					stream->state = STREAM_STATE_VALUE;
+					p++;
+				} else {
+					stream->state = STREAM_STATE_ERROR;
+				}
+			break;
+
+			case STREAM_STATE_VALUE:
+				if (g_ascii_isspace (*p)) {
+					p++;
+				} else if (*p == '[' && g_str_has_suffix (stream->key->str, "_log")) {
+					stream->state = STREAM_STATE_ARRAY;
+					p++;
+				} else {
+					g_string_truncate (stream->value, 0);
+					stream_begin_value (stream, STREAM_STATE_MEMBER);
+				}
+			break;
+
+			case STREAM_STATE_MEMBER:
+				n = stream_scan_value (stream, p, end - p, &complete);
+				g_string_append_len (stream->value, p, n);
+				p += n;
+				if (complete) {
+					enum json_tokener_error jerr = json_tokener_success;
+					json_object *obj = json_tokener_parse_verbose (stream->value->str, &jerr);
+					if (jerr == json_tokener_success) {
+						if (stream->member_func)
+							stream->member_func (stream->key->str, obj, stream->data);
+						json_object_put (obj);
+					}
+					stream->state = STREAM_STATE_KEY;
+				}
+			break;
+
+			case STREAM_STATE_ARRAY:
+				if (g_ascii_isspace (*p) || *p == ',') {
+					p++;
+				} else if (*p == ']') {
+					stream->state = STREAM_STATE_KEY;
+					p++;
+				} else if (*p == '{') {
+					json_tokener_reset (stream->tokener);
+					stream_begin_value (stream, STREAM_STATE_ELEMENT);
+				} else {
+					stream_begin_value (stream, STREAM_STATE_SKIP);
+				}
+			break;
+
+			case STREAM_STATE_ELEMENT:
+			{
+				json_object *obj;
+
+				n = stream_scan_value (stream, p, end - p, &complete);
+				obj = json_tokener_parse_ex (stream->tokener, p, n);
+				p += n;
+
+				if (complete) {
+					if (obj) {
+						if (stream->entry_func)
+							stream->entry_func (stream->key->str, obj, stream->data);
+						json_object_put (obj);
+					}
+					stream->state = STREAM_STATE_ARRAY;
+				} else if (json_tokener_get_error (stream->tokener) != json_tokener_continue) {
+					stream->state = STREAM_STATE_ERROR;
+				}
+			}
+			break;
+
+			case STREAM_STATE_SKIP:
+				n = stream_scan_value (stream, p, end - p, &complete);
+				p += n;
+				if (complete)
+					stream->state = STREAM_STATE_ARRAY;
+			break;
+
+			default:
+			break;
+		}
+	}
+
+	return (stream->state != STREAM_STATE_ERROR);
+}
+
+#define SYSTEMD_NAME                   "org.freedesktop.systemd1"
+#define SYSTEMD_PATH                   "/org/freedesktop/systemd1"
+#define SYSTEMD_MANAGER_INTERFACE      "org.freedesktop.systemd1.Manager"
+#define SYSTEMD_UNIT_INTERFACE         "org.freedesktop.systemd1.Unit"
+#define SYSTEMD_CALL_TIMEOUT           3000 /* msec, the blocking calls run on the UI thread */
+
+/*
+ * Unit state is read from systemd once per unit and then kept up to date
+ * from its PropertiesChanged and UnitFilesChanged signals, so the
+ * is_systemd_service_*() checks never go to the bus again.  A unit's
+ * watchers are told whenever its ActiveState or UnitFileState changes.
+ */
+typedef struct {
+	guint                   id;
+	SystemdUnitChangedFunc  func;
+	gpointer                data;
+} SystemdUnitWatcher;
+
+typedef struct {
+	gchar  *name;
+	gchar  *object_path;
+	gchar  *active_state;
+	gchar  *unit_file_state; /* NULL if there is no such unit file */
+	guint   properties_id;
+	GSList *watchers;
+} SystemdUnit;
+
+static GHashTable *systemd_units = NULL;
+static guint       systemd_unit_files_id = 0;
+static guint       systemd_watcher_next_id = 1;
+
+static void
+systemd_unit_set (SystemdUnit *unit, gchar **field, const gchar *value)
+{
+	GSList *l, *next;
+
+	if (g_strcmp0 (*field, value) == 0)
+		return;
+
+	g_free (*field);
+	*field = g_strdup (value);
+
+	for (l = unit->watchers; l; l = next) {
+		SystemdUnitWatcher *watcher = l->data;
+
+		/* a watcher may remove itself */
+		next = l->next;
+		watcher->func (unit->name, watcher->data);
+	}
+}
+
+static void
+systemd_unit_load_sync (SystemdUnit *unit, GDBusConnection *bus)
+{
+	GVariant *reply, *value;
+	gchar *state = NULL;
+
+	reply = g_dbus_connection_call_sync (bus, SYSTEMD_NAME, SYSTEMD_PATH,
+                                         SYSTEMD_MANAGER_INTERFACE, "GetUnitFileState",
+                                         g_variant_new ("(s)", unit->name),
+                                         G_VARIANT_TYPE ("(s)"),
+                                         G_DBUS_CALL_FLAGS_NONE, SYSTEMD_CALL_TIMEOUT, NULL, NULL);
+	if (reply) {
+		g_variant_get (reply, "(s)", &state);
+		g_variant_unref (reply);
+	}
+	systemd_unit_set (unit, &unit->unit_file_state, state);
+	g_free (state);
+	state = NULL;
+
+	if (!unit->object_path) {
+		/* unlike GetUnit, LoadUnit also answers for inactive units */
+		reply = g_dbus_connection_call_sync (bus, SYSTEMD_NAME, SYSTEMD_PATH,
+                                             SYSTEMD_MANAGER_INTERFACE, "LoadUnit",
+                                             g_variant_new ("(s)", unit->name),
+                                             G_VARIANT_TYPE ("(o)"),
+                                             G_DBUS_CALL_FLAGS_NONE, SYSTEMD_CALL_TIMEOUT, NULL, NULL);
+		if (!reply)
+			return;
+
+		g_variant_get (reply, "(o)", &unit->object_path);
+		g_variant_unref (reply);
+	}
+
+	reply = g_dbus_connection_call_sync (bus, SYSTEMD_NAME, unit->object_path,
+                                         "org.freedesktop.DBus.Properties", "Get",
+                                         g_variant_new ("(ss)", SYSTEMD_UNIT_INTERFACE, "ActiveState"),
+                                         G_VARIANT_TYPE ("(v)"),
+                                         G_DBUS_CALL_FLAGS_NONE, SYSTEMD_CALL_TIMEOUT, NULL, NULL);
+	if (reply) {
+		g_variant_get (reply, "(v)", &value);
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+			state = g_variant_dup_string (value, NULL);
+		g_variant_unref (value);
+		g_variant_unref (reply);
+	}
+	systemd_unit_set (unit, &unit->active_state, state);
+	g_free (state);
+}
+
+static void
+systemd_unit_active_state_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GVariant *reply, *value;
+	SystemdUnit *unit = data;
+
+	reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, NULL);
+	if (!reply)
+		return;
+
+	g_variant_get (reply, "(v)", &value);
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+		systemd_unit_set (unit, &unit->active_state, g_variant_get_string (value, NULL));
+	g_variant_unref (value);
+	g_variant_unref (reply);
+}
+
+static void
+systemd_unit_properties_changed_cb (GDBusConnection *connection,
+                                    const gchar     *sender,
+                                    const gchar     *object_path,
+                                    const gchar     *interface_name,
+                                    const gchar     *signal_name,
+                                    GVariant        *parameters,
+                                    gpointer         data)
+{
+	const gchar *interface, *state;
+	const gchar **invalidated;
+	GVariant *changed;
+	SystemdUnit *unit = data;
+
+	g_variant_get (parameters, "(&s@a{sv}^a&s)", &interface, &changed, &invalidated);
+
+	if (g_str_equal (interface, SYSTEMD_UNIT_INTERFACE)) {
+		if (g_variant_lookup (changed, "ActiveState", "&s", &state)) {
+			systemd_unit_set (unit, &unit->active_state, state);
+		} else if (g_strv_contains (invalidated, "ActiveState")) {
+			g_dbus_connection_call (connection, SYSTEMD_NAME, unit->object_path,
+                                    "org.freedesktop.DBus.Properties", "Get",
+                                    g_variant_new ("(ss)", SYSTEMD_UNIT_INTERFACE, "ActiveState"),
+                                    G_VARIANT_TYPE ("(v)"),
+                                    G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+                                    systemd_unit_active_state_cb, unit);
+		}
+	}
+
+	g_variant_unref (changed);
+	g_free (invalidated);
+}
+
+static void
+systemd_unit_file_state_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GVariant *reply;
+	const gchar *state = NULL;
+	SystemdUnit *unit = data;
+
+	reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, NULL);
+	if (reply)
+		g_variant_get (reply, "(&s)", &state);
+
+	systemd_unit_set (unit, &unit->unit_file_state, state);
+
+	if (reply)
+		g_variant_unref (reply);
+}
+
+static void
+systemd_unit_files_changed_cb (GDBusConnection *connection,
+                               const gchar     *sender,
+                               const gchar     *object_path,
+                               const gchar     *interface_name,
+                               const gchar     *signal_name,
+                               GVariant        *parameters,
+                               gpointer         data)
+{
+	GHashTableIter iter;
+	SystemdUnit *unit;
+
+	g_hash_table_iter_init (&iter, systemd_units);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &unit)) {
+		g_dbus_connection_call (connection, SYSTEMD_NAME, SYSTEMD_PATH,
+                                SYSTEMD_MANAGER_INTERFACE, "GetUnitFileState",
+                                g_variant_new ("(s)", unit->name),
+                                G_VARIANT_TYPE ("(s)"),
+                                G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+                                systemd_unit_file_state_cb, unit);
+	}
+}
+
+/* Returns the cached state of @unit_name, reading it from systemd and
+ * subscribing to its changes the first time.  Units are kept for the
+ * life of the process. */
+static SystemdUnit *
+systemd_unit_get (const gchar *unit_name)
+{
+	SystemdUnit *unit;
+	GDBusConnection *bus;
+
+	if (systemd_units) {
+		unit = g_hash_table_lookup (systemd_units, unit_name);
+		if (unit)
+			return unit;
+	}
+
+	bus = system_bus_get (NULL);
+	if (!bus)
+		return NULL;
+
+	if (!systemd_units) {
+		systemd_units = g_hash_table_new (g_str_hash, g_str_equal);
+
+		/* systemd only emits unit signals to subscribed clients */
+		g_dbus_connection_call (bus, SYSTEMD_NAME, SYSTEMD_PATH,
+                                SYSTEMD_MANAGER_INTERFACE, "Subscribe",
+                                NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+                                NULL, NULL, NULL);
+
+		systemd_unit_files_id = g_dbus_connection_signal_subscribe (bus,
+                                                                    SYSTEMD_NAME,
+                                                                    SYSTEMD_MANAGER_INTERFACE,
+                                                                    "UnitFilesChanged",
+                                                                    SYSTEMD_PATH,
+                                                                    NULL,
+                                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                    systemd_unit_files_changed_cb,
+                                                                    NULL, NULL);
+	}
+
+	unit = g_new0 (SystemdUnit, 1);
+	unit->name = g_strdup (unit_name);
+	g_hash_table_insert (systemd_units, unit->name, unit);
+
+	systemd_unit_load_sync (unit, bus);
+
+	if (unit->object_path) {
+		unit->properties_id = g_dbus_connection_signal_subscribe (bus,
+                                                                  SYSTEMD_NAME,
+                                                                  "org.freedesktop.DBus.Properties",
+                                                                  "PropertiesChanged",
+                                                                  unit->object_path,
+                                                                  SYSTEMD_UNIT_INTERFACE,
+                                                                  G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                  systemd_unit_properties_changed_cb,
+                                                                  unit, NULL);
+	}
+
+	return unit;
+}
+
+/* Calls @func whenever the ActiveState or UnitFileState of @unit_name
+ * changes.  Returns an id for systemd_unit_watch_remove(), or 0. */
+guint
+systemd_unit_watch_add (const gchar *unit_name, SystemdUnitChangedFunc func, gpointer data)
+{
+	SystemdUnitWatcher *watcher;
+	SystemdUnit *unit = systemd_unit_get (unit_name);
+
+	if (!unit)
+		return 0;
+
+	watcher = g_new0 (SystemdUnitWatcher, 1);
+	watcher->id = systemd_watcher_next_id++;
+	watcher->func = func;
+	watcher->data = data;
+
+	unit->watchers = g_slist_append (unit->watchers, watcher);
+
+	return watcher->id;
+}
+
+void
+systemd_unit_watch_remove (guint id)
+{
+	GHashTableIter iter;
+	SystemdUnit *unit;
+
+	if (id == 0 || !systemd_units)
+		return;
+
+	g_hash_table_iter_init (&iter, systemd_units);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &unit)) {
+		GSList *l;
+		for (l = unit->watchers; l; l = l->next) {
+			SystemdUnitWatcher *watcher = l->data;
+			if (watcher->id == id) {
+				unit->watchers = g_slist_delete_link (unit->watchers, l);
+				g_free (watcher);
+				return;
+			}
+		}
+	}
+}
+
+/* Reads the state of @unit_name again right away, for callers that have
+ * just changed it and cannot wait for the signal. */
+void
+systemd_unit_refresh (const gchar *unit_name)
+{
+	SystemdUnit *unit = systemd_unit_get (unit_name);
+	GDBusConnection *bus = system_bus_get (NULL);
+
+	if (unit && bus)
+		systemd_unit_load_sync (unit, bus);
+}
+
+gboolean
+is_systemd_service_available (const gchar *service_name)
+{
+	SystemdUnit *unit = systemd_unit_get (service_name);
+
+	return (unit && unit->unit_file_state);
+}
 
 gboolean
 is_standalone_mode (void)
@@ -357,53 +1760,7 @@ is_standalone_mode (void)
 gboolean
 is_systemd_service_active (const gchar *service_name)
 {
-	gboolean ret = FALSE;
-
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
-	gchar      *obj_path = NULL;
+	SystemdUnit *unit = systemd_unit_get (service_name);
 
-	get_object_path (&obj_path, service_name);
-	if (!obj_path) {
-		goto done;
-	}
-
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			obj_path,
-			"org.freedesktop.DBus.Properties",
-			NULL, &error);
-
-	if (!proxy) {
-		goto done;
-	}
-
-	variant = g_dbus_proxy_call_sync (proxy, "GetAll",
-			g_variant_new ("(s)", "org.freedesktop.systemd1.Unit"),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-
-	if (variant) {
-		gchar *output = NULL;
-		GVariant *asv = g_variant_get_child_value(variant, 0);
-		GVariant *value = g_variant_lookup_value(asv, "ActiveState", NULL);
-		if(value && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
-			output = g_variant_dup_string(value, NULL);
-			if (g_strcmp0 (output, "active") == 0) {
-				ret = TRUE;;
-			}
-			g_free (output);
-		}
-
-		g_variant_unref (variant);
-	}
-
-	g_object_unref (proxy);
-
-done:
-	if (error)
-		g_error_free (error);
-
-	return ret;
+	return (unit && g_strcmp0 (unit->active_state, "active") == 0);
 }
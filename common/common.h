@@ -32,6 +32,17 @@ G_BEGIN_DECLS
 #define GOOROOM_SECURITY_LOGPARSER_SEEKTIME    "/var/tmp/GOOROOM-SECURITY-LOGPARSER-SEEKTIME"
 #define GOOROOM_MANAGEMENT_SERVER_CONF         "/etc/gooroom/gooroom-client-server-register/gcsr.conf"
 #define GOOROOM_AGENT_SERVICE_NAME             "gooroom-agent.service"
+#define GOOROOM_SECURITY_LOGPARSER_JSON_ANCHOR "JSON-ANCHOR="
+#define GOOROOM_SECURITY_LOGPARSER_FRAME_MAGIC "GRSLOGF1"
+
+#define GOOROOM_AGENT_NAME                     "kr.gooroom.agent"
+#define GOOROOM_AGENT_PATH                     "/kr/gooroom/agent"
+#define GOOROOM_AGENT_INTERFACE                "kr.gooroom.agent"
+#define GOOROOM_AGENT_TASK_TIMEOUT             5000 /* msec */
+
+#define GOOROOM_SECURITY_STATUS_HELPER_NAME      "kr.gooroom.security.status.Helper"
+#define GOOROOM_SECURITY_STATUS_HELPER_PATH      "/kr/gooroom/security/status/Helper"
+#define GOOROOM_SECURITY_STATUS_HELPER_INTERFACE "kr.gooroom.security.status.Helper"
 
 #define	DEFAULT_YEAR                            1970 
 #define	DEFAULT_MONTH                           1
@@ -65,6 +76,39 @@ enum {
     ACCOUNT_TYPE_UNKNOWN
 };
 
+typedef struct _SecurityLogStream SecurityLogStream;
+
+typedef void (*SecurityLogEntryFunc)  (const gchar *category,
+                                       json_object *entry,
+                                       gpointer     data);
+
+typedef void (*SecurityLogMemberFunc) (const gchar *key,
+                                       json_object *value,
+                                       gpointer     data);
+
+typedef void (*SecurityLogFlushFunc)  (gpointer     data);
+
+typedef void (*SecurityLogDoneFunc)   (gboolean     complete,
+                                       gpointer     data);
+
+typedef void (*SecurityLogStartFunc)  (const gchar *seektime,
+                                       gpointer     data);
+
+typedef void (*SystemdUnitChangedFunc) (const gchar *unit_name,
+                                        gpointer     data);
+
+/* Callbacks of one run_security_log_parser_async() request.  Any of them
+ * may be NULL.  start_func is told the seektime the parser is run from,
+ * flush_func is called after each batch of parser output, done_func
+ * exactly once at the end. */
+typedef struct {
+	SecurityLogEntryFunc   entry_func;
+	SecurityLogMemberFunc  member_func;
+	SecurityLogFlushFunc   flush_func;
+	SecurityLogDoneFunc    done_func;
+	SecurityLogStartFunc   start_func;
+} SecurityLogParserFuncs;
+
 
 json_object *JSON_OBJECT_GET                      (json_object *obj,
                                                    const gchar *key);
@@ -74,9 +118,19 @@ gboolean     is_admin_group                       (void);
 gboolean     is_standalone_mode                   (void);
 int          get_account_type                     (const char *user);
 
-gboolean     run_security_log_parser_async        (gchar    *seektime,
-                                                   GIOFunc   callback_func,
-                                                   gpointer  data);
+gboolean     run_security_log_parser_async        (const gchar                  *seektime,
+                                                   const SecurityLogParserFuncs *funcs,
+                                                   GCancellable                 *cancellable,
+                                                   gpointer                      data);
+
+SecurityLogStream *security_log_stream_new       (SecurityLogEntryFunc   entry_func,
+                                                   SecurityLogMemberFunc  member_func,
+                                                   gpointer               data);
+gboolean     security_log_stream_feed             (SecurityLogStream     *stream,
+                                                   const gchar           *buf,
+                                                   gsize                  len);
+gboolean     security_log_stream_is_done          (SecurityLogStream     *stream);
+void         security_log_stream_free             (SecurityLogStream     *stream);
 
 gboolean     authenticate                         (const gchar *action_id);
 
@@ -84,9 +138,43 @@ gboolean     is_systemd_service_active            (const gchar *service_name);
 
 gboolean     is_systemd_service_available         (const gchar *service_name);
 
+guint        systemd_unit_watch_add               (const gchar            *unit_name,
+                                                   SystemdUnitChangedFunc  func,
+                                                   gpointer                data);
+void         systemd_unit_watch_remove            (guint                   id);
+void         systemd_unit_refresh                 (const gchar            *unit_name);
+
+void         agent_do_task_async                  (const gchar         *module,
+                                                   const gchar         *task,
+                                                   json_object         *in,
+                                                   gint                 timeout_msec,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             data);
+json_object *agent_do_task_finish                 (GAsyncResult        *res,
+                                                   GError             **error);
+json_object *agent_do_task_sync                   (const gchar         *module,
+                                                   const gchar         *task,
+                                                   json_object         *in,
+                                                   gint                 timeout_msec,
+                                                   GError             **error);
+
 void         send_taking_measures_signal_to_agent (void);
 void         send_taking_measure_signal_to_self   (void);
 
+GVariant    *security_status_helper_call_sync     (const gchar         *method,
+                                                   GVariant            *parameters,
+                                                   gint                *out_fd);
+gboolean     security_status_helper_call          (const gchar         *method,
+                                                   GVariant            *parameters,
+                                                   gint                 timeout_msec,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             data);
+GVariant    *security_status_helper_call_finish   (GAsyncResult        *res,
+                                                   gint                *out_fd,
+                                                   GError             **error);
+
 
 G_END_DECLS
 
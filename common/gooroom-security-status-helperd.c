@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Bus activated system service doing the root-only work of the security
+ * status tools.  Each method is authorized against the polkit action of
+ * the pkexec helper it replaces, so the policy stays in one place.
+ * Methods producing a stream hand the caller the read end of the
+ * child's stdout instead of copying it over the bus.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <polkit/polkit.h>
+
+#include "common.h"
+
+
+#define HELPER_IDLE_TIMEOUT            300 /* seconds */
+
+#define PRODUCT_UUID_PATH              "/sys/devices/virtual/dmi/id/product_uuid"
+#define LOGPARSER_SEEKTIME_PATH        "/var/tmp/GOOROOM-SECURITY-LOGPARSER-SEEKTIME"
+#define SECURITY_STATUS_VULNERABLE     "/var/tmp/GOOROOM-SECURITY-STATUS-VULNERABLE"
+#define IPTABLES_SAVE                  "/usr/sbin/iptables-legacy-save"
+#define IP6TABLES_SAVE                 "/usr/sbin/ip6tables-legacy-save"
+
+#define ACTION_LOGPARSER_SEEKTIME      "kr.gooroom.security.status.tools.logparser.seektime"
+#define ACTION_RECORD_VULNERABLE       "kr.gooroom.security.status.tools.record.vulnerable"
+#define ACTION_LOGPARSER_RUN           "kr.gooroom.security.status.tools.logparser.run"
+#define ACTION_PRODUCT_UUID            "kr.gooroom.security.status.tools.product-uuid-helper"
+#define ACTION_IPTABLES                "kr.gooroom.security.status.tools.iptables-wrapper"
+#define ACTION_IP6TABLES               "kr.gooroom.security.status.tools.ip6tables-wrapper"
+#define ACTION_PROBE                   "kr.gooroom.security.status.tools.probe"
+
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='" GOOROOM_SECURITY_STATUS_HELPER_INTERFACE "'>"
+	"    <method name='GetProductUuid'>"
+	"      <arg type='s' name='uuid' direction='out'/>"
+	"    </method>"
+	"    <method name='ListFirewallRules'>"
+	"      <arg type='b' name='ipv6' direction='in'/>"
+	"      <arg type='h' name='output' direction='out'/>"
+	"    </method>"
+	"    <method name='GetFirewallFingerprint'>"
+	"      <arg type='b' name='ipv6' direction='in'/>"
+	"      <arg type='s' name='fingerprint' direction='out'/>"
+	"    </method>"
+	"    <method name='Probe'>"
+	"      <arg type='h' name='output' direction='out'/>"
+	"    </method>"
+	"    <method name='RunLogParser'>"
+	"      <arg type='s' name='seektime' direction='in'/>"
+	"      <arg type='s' name='lang' direction='in'/>"
+	"      <arg type='h' name='output' direction='out'/>"
+	"    </method>"
+	"    <method name='UpdateLogParserSeektime'/>"
+	"    <method name='RecordVulnerable'>"
+	"      <arg type='u' name='vulnerable' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+static GMainLoop       *loop = NULL;
+static GDBusNodeInfo   *introspection_data = NULL;
+static PolkitAuthority *authority = NULL;
+static guint            n_pending = 0;
+static guint            idle_timeout_id = 0;
+
+
+static gboolean
+idle_timeout_cb (gpointer data)
+{
+	idle_timeout_id = 0;
+
+	if (n_pending == 0)
+		g_main_loop_quit (loop);
+
+	return FALSE;
+}
+
+static void
+idle_timeout_reset (void)
+{
+	if (idle_timeout_id > 0)
+		g_source_remove (idle_timeout_id);
+
+	idle_timeout_id = g_timeout_add_seconds (HELPER_IDLE_TIMEOUT, idle_timeout_cb, NULL);
+}
+
+static void
+invocation_done (void)
+{
+	n_pending--;
+	idle_timeout_reset ();
+}
+
+static gboolean
+is_valid_arg (const gchar *arg, const gchar *extra_chars)
+{
+	const gchar *p;
+
+	for (p = arg; *p; p++) {
+		if (!g_ascii_isalnum (*p) && !strchr (extra_chars, *p))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+child_watch_cb (GPid pid, gint status, gpointer data)
+{
+	g_spawn_close_pid (pid);
+}
+
+/* Spawns @argv and returns the read end of its stdout to the caller. */
+static void
+return_child_output (GDBusMethodInvocation *invocation, gchar **argv)
+{
+	GPid pid;
+	gint stdout_fd;
+	GError *error = NULL;
+	GUnixFDList *fd_list;
+
+	if (!g_spawn_async_with_pipes (NULL, argv, NULL,
+                                   G_SPAWN_DO_NOT_REAP_CHILD,
+                                   NULL, NULL, &pid,
+                                   NULL, &stdout_fd, NULL, &error)) {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		g_error_free (error);
+		return;
+	}
+
+	g_child_watch_add (pid, child_watch_cb, NULL);
+
+	fd_list = g_unix_fd_list_new ();
+	g_unix_fd_list_append (fd_list, stdout_fd, NULL);
+	close (stdout_fd);
+
+	g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                             g_variant_new ("(h)", 0),
+                                                             fd_list);
+	g_object_unref (fd_list);
+}
+
+/*
+ * Hashes the rules of an iptables-save dump, leaving out the comments,
+ * which carry the time of the dump, and the chain counters.
+ */
+static gchar *
+firewall_fingerprint (GBytes *dump)
+{
+	gsize size;
+	gchar *fingerprint;
+	GChecksum *checksum;
+	const gchar *p, *end;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	p = g_bytes_get_data (dump, &size);
+	end = p ? p + size : NULL;
+
+	while (p && p < end) {
+		const gchar *eol = memchr (p, '\n', end - p);
+		const gchar *line_end;
+
+		if (!eol)
+			eol = end;
+
+		line_end = eol;
+		if (*p == ':') {
+			/* ":INPUT ACCEPT [packets:bytes]" */
+			const gchar *counters = g_strrstr_len (p, eol - p, " [");
+			if (counters)
+				line_end = counters;
+		}
+
+		if (*p != '#') {
+			g_checksum_update (checksum, (const guchar *)p, line_end - p);
+			g_checksum_update (checksum, (const guchar *)"\n", 1);
+		}
+
+		p = (eol < end) ? eol + 1 : end;
+	}
+
+	fingerprint = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+
+	return fingerprint;
+}
+
+static void
+return_file_contents (GDBusMethodInvocation *invocation, const gchar *path, const gchar *contents)
+{
+	GError *error = NULL;
+
+	if (g_file_set_contents (path, contents, -1, &error)) {
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		g_error_free (error);
+	}
+}
+
+static void
+fingerprint_communicate_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GBytes *dump = NULL;
+	GError *error = NULL;
+	GDBusMethodInvocation *invocation = data;
+
+	if (g_subprocess_communicate_finish (G_SUBPROCESS (source), res, &dump, NULL, &error)) {
+		gchar *fingerprint = firewall_fingerprint (dump);
+
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", fingerprint));
+
+		g_free (fingerprint);
+		g_bytes_unref (dump);
+	} else {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		g_error_free (error);
+	}
+
+	g_object_unref (source);
+	invocation_done ();
+}
+
+static void
+handle_authorized_call (GDBusMethodInvocation *invocation)
+{
+	const gchar *method = g_dbus_method_invocation_get_method_name (invocation);
+	GVariant *parameters = g_dbus_method_invocation_get_parameters (invocation);
+
+	if (g_str_equal (method, "GetProductUuid")) {
+		gchar *uuid = NULL;
+
+		g_file_get_contents (PRODUCT_UUID_PATH, &uuid, NULL, NULL);
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(s)", uuid ? g_strstrip (uuid) : ""));
+		g_free (uuid);
+	} else if (g_str_equal (method, "ListFirewallRules")) {
+		gboolean ipv6;
+		gchar *argv[2] = { NULL, NULL };
+
+		g_variant_get (parameters, "(b)", &ipv6);
+		argv[0] = ipv6 ? GOOROOM_IP6TABLES_WRAPPER : GOOROOM_IPTABLES_WRAPPER;
+
+		return_child_output (invocation, argv);
+	} else if (g_str_equal (method, "GetFirewallFingerprint")) {
+		gboolean ipv6;
+		GError *error = NULL;
+		GSubprocess *subprocess;
+
+		g_variant_get (parameters, "(b)", &ipv6);
+
+		/* no counters, so the dump only changes with the rules */
+		subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+                                       &error, ipv6 ? IP6TABLES_SAVE : IPTABLES_SAVE, NULL);
+		if (!subprocess) {
+			g_dbus_method_invocation_return_gerror (invocation, error);
+			g_error_free (error);
+			return;
+		}
+
+		n_pending++;
+		g_subprocess_communicate_async (subprocess, NULL, NULL, fingerprint_communicate_cb, invocation);
+	} else if (g_str_equal (method, "Probe")) {
+		gchar *argv[2] = { GOOROOM_SECURITY_STATUS_PROBE, NULL };
+
+		return_child_output (invocation, argv);
+	} else if (g_str_equal (method, "RunLogParser")) {
+		gint n = 0;
+		const gchar *seektime, *lang;
+		gchar *argv[4] = { NULL, };
+
+		g_variant_get (parameters, "(&s&s)", &seektime, &lang);
+
+		if (!is_valid_arg (seektime, "-.") || !is_valid_arg (lang, "_.@-")) {
+			g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_INVALID_ARGS,
+                                                   "Invalid seektime or language");
+			return;
+		}
+
+		/* same arguments as the pkexec'd wrapper gets */
+		argv[n++] = GOOROOM_SECURITY_LOGPARSER_WRAPPER;
+		if (*seektime)
+			argv[n++] = (gchar *)seektime;
+		argv[n++] = (gchar *)lang;
+
+		return_child_output (invocation, argv);
+	} else if (g_str_equal (method, "UpdateLogParserSeektime")) {
+		GDateTime *now = g_date_time_new_now_local ();
+		gchar *date = g_date_time_format (now, "%Y%m%d-%H%M%S");
+		gchar *seektime = g_strdup_printf ("%s.%06d", date, g_date_time_get_microsecond (now));
+
+		return_file_contents (invocation, LOGPARSER_SEEKTIME_PATH, seektime);
+
+		g_free (seektime);
+		g_free (date);
+		g_date_time_unref (now);
+	} else if (g_str_equal (method, "RecordVulnerable")) {
+		guint vulnerable;
+		gchar *contents;
+
+		g_variant_get (parameters, "(u)", &vulnerable);
+
+		contents = g_strdup_printf ("%u", vulnerable);
+		return_file_contents (invocation, SECURITY_STATUS_VULNERABLE, contents);
+		g_free (contents);
+	} else {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                               G_DBUS_ERROR_UNKNOWN_METHOD,
+                                               "Unknown method %s", method);
+	}
+}
+
+static void
+check_authorization_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GError *error = NULL;
+	PolkitAuthorizationResult *result;
+	GDBusMethodInvocation *invocation = data;
+
+	result = polkit_authority_check_authorization_finish (POLKIT_AUTHORITY (source), res, &error);
+
+	if (!result) {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		g_error_free (error);
+	} else if (!polkit_authorization_result_get_is_authorized (result)) {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                               G_DBUS_ERROR_ACCESS_DENIED,
+                                               "Not authorized");
+	} else {
+		handle_authorized_call (invocation);
+	}
+
+	if (result)
+		g_object_unref (result);
+
+	invocation_done ();
+}
+
+static const gchar *
+method_action_id (const gchar *method, GVariant *parameters)
+{
+	if (g_str_equal (method, "GetProductUuid"))
+		return ACTION_PRODUCT_UUID;
+
+	if (g_str_equal (method, "ListFirewallRules") ||
+        g_str_equal (method, "GetFirewallFingerprint")) {
+		gboolean ipv6;
+		g_variant_get (parameters, "(b)", &ipv6);
+		return ipv6 ? ACTION_IP6TABLES : ACTION_IPTABLES;
+	}
+
+	if (g_str_equal (method, "Probe"))
+		return ACTION_PROBE;
+
+	if (g_str_equal (method, "RunLogParser"))
+		return ACTION_LOGPARSER_RUN;
+
+	if (g_str_equal (method, "UpdateLogParserSeektime"))
+		return ACTION_LOGPARSER_SEEKTIME;
+
+	if (g_str_equal (method, "RecordVulnerable"))
+		return ACTION_RECORD_VULNERABLE;
+
+	return NULL;
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               data)
+{
+	PolkitSubject *subject;
+	const gchar *action_id;
+
+	action_id = method_action_id (method_name, parameters);
+	if (!action_id) {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                               G_DBUS_ERROR_UNKNOWN_METHOD,
+                                               "Unknown method %s", method_name);
+		return;
+	}
+
+	n_pending++;
+
+	subject = polkit_system_bus_name_new (sender);
+	polkit_authority_check_authorization (authority, subject, action_id, NULL,
+                                          POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
+                                          NULL, check_authorization_cb, invocation);
+	g_object_unref (subject);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	handle_method_call,
+	NULL,
+	NULL
+};
+
+static void
+on_bus_acquired (GDBusConnection *connection, const gchar *name, gpointer data)
+{
+	GError *error = NULL;
+
+	if (!g_dbus_connection_register_object (connection,
+                                            GOOROOM_SECURITY_STATUS_HELPER_PATH,
+                                            introspection_data->interfaces[0],
+                                            &interface_vtable,
+                                            NULL, NULL, &error)) {
+		g_critical ("Error registering object: %s", error->message);
+		g_error_free (error);
+		g_main_loop_quit (loop);
+	}
+}
+
+static void
+on_name_lost (GDBusConnection *connection, const gchar *name, gpointer data)
+{
+	g_main_loop_quit (loop);
+}
+
+int
+main (int argc, char **argv)
+{
+	guint owner_id;
+	GError *error = NULL;
+
+	authority = polkit_authority_get_sync (NULL, &error);
+	if (!authority) {
+		g_critical ("Error getting polkit authority: %s", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	introspection_data = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+
+	loop = g_main_loop_new (NULL, FALSE);
+
+	owner_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
+                               GOOROOM_SECURITY_STATUS_HELPER_NAME,
+                               G_BUS_NAME_OWNER_FLAGS_NONE,
+                               on_bus_acquired,
+                               NULL,
+                               on_name_lost,
+                               NULL, NULL);
+
+	idle_timeout_reset ();
+
+	g_main_loop_run (loop);
+
+	g_bus_unown_name (owner_id);
+	g_dbus_node_info_unref (introspection_data);
+	g_object_unref (authority);
+	g_main_loop_unref (loop);
+
+	return 0;
+}
@@ -0,0 +1,552 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Counts the source packages with a pending update and prints
+ * "packages=N" (-1 on failure), like the apt based script it replaces.
+ * The dpkg status file and the apt list indices are mapped and scanned
+ * in place; only installed packages are copied out.
+ *
+ * The candidate is chosen the way apt's default policy does: the
+ * version with the highest archive priority wins, newer wins between
+ * equal priorities and nothing older than the installed version is
+ * considered.  Archive priorities come from the NotAutomatic and
+ * ButAutomaticUpgrades fields of the Release files; apt_preferences(5)
+ * pins are not read.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+
+#define DPKG_STATUS_FILE           "/var/lib/dpkg/status"
+#define APT_LISTS_DIR              "/var/lib/apt/lists"
+
+#define PRIORITY_DEFAULT           500
+#define PRIORITY_INSTALLED         100
+#define PRIORITY_BUT_AUTOMATIC     100
+#define PRIORITY_NOT_AUTOMATIC     1
+
+
+typedef struct {
+	const gchar *ptr;
+	gsize        len;
+} Field;
+
+typedef struct {
+	Field package;
+	Field version;
+	Field arch;
+	Field status;
+	Field source;
+} Stanza;
+
+typedef struct {
+	gchar *version;
+	gint   version_priority;
+	gchar *candidate;
+	gint   candidate_priority;
+	gchar *source;
+} Package;
+
+
+static gboolean
+field_equal (const Field *field, const gchar *str)
+{
+	gsize len = strlen (str);
+
+	return (field->len == len && memcmp (field->ptr, str, len) == 0);
+}
+
+static void
+package_free (gpointer data)
+{
+	Package *pkg = data;
+
+	g_free (pkg->version);
+	g_free (pkg->candidate);
+	g_free (pkg->source);
+	g_free (pkg);
+}
+
+/* Fills @st with the fields of the stanza starting at @p and returns
+ * the start of the next one. */
+static const gchar *
+stanza_parse (const gchar *p, const gchar *end, Stanza *st)
+{
+	memset (st, 0, sizeof (Stanza));
+
+	while (p < end) {
+		const gchar *eol, *colon, *value, *value_end;
+		Field *field = NULL;
+		gsize name_len;
+
+		eol = memchr (p, '\n', end - p);
+		if (!eol)
+			eol = end;
+
+		if (eol == p)
+			return p + 1;
+
+		colon = (*p == ' ' || *p == '\t') ? NULL : memchr (p, ':', eol - p);
+		if (colon) {
+			name_len = colon - p;
+			if (name_len == 7 && g_ascii_strncasecmp (p, "Package", 7) == 0)
+				field = &st->package;
+			else if (name_len == 7 && g_ascii_strncasecmp (p, "Version", 7) == 0)
+				field = &st->version;
+			else if (name_len == 12 && g_ascii_strncasecmp (p, "Architecture", 12) == 0)
+				field = &st->arch;
+			else if (name_len == 6 && g_ascii_strncasecmp (p, "Status", 6) == 0)
+				field = &st->status;
+			else if (name_len == 6 && g_ascii_strncasecmp (p, "Source", 6) == 0)
+				field = &st->source;
+		}
+
+		if (field) {
+			value = colon + 1;
+			value_end = eol;
+			while (value < value_end && g_ascii_isspace (*value))
+				value++;
+			while (value_end > value && g_ascii_isspace (value_end[-1]))
+				value_end--;
+
+			field->ptr = value;
+			field->len = value_end - value;
+		}
+
+		p = (eol < end) ? eol + 1 : end;
+	}
+
+	return end;
+}
+
+static gint
+version_order (gint c)
+{
+	if (g_ascii_isdigit (c))
+		return 0;
+	if (g_ascii_isalpha (c))
+		return c;
+	if (c == '~')
+		return -1;
+	if (c)
+		return c + 256;
+
+	return 0;
+}
+
+/* dpkg's verrevcmp() on unterminated slices */
+static gint
+verrevcmp (const gchar *a, const gchar *a_end, const gchar *b, const gchar *b_end)
+{
+	while (a < a_end || b < b_end) {
+		gint first_diff = 0;
+
+		while ((a < a_end && !g_ascii_isdigit (*a)) || (b < b_end && !g_ascii_isdigit (*b))) {
+			gint ac = version_order ((a < a_end) ? (guchar) *a : 0);
+			gint bc = version_order ((b < b_end) ? (guchar) *b : 0);
+
+			if (ac != bc)
+				return ac - bc;
+
+			a++;
+			b++;
+		}
+
+		while (a < a_end && *a == '0')
+			a++;
+		while (b < b_end && *b == '0')
+			b++;
+
+		while (a < a_end && b < b_end && g_ascii_isdigit (*a) && g_ascii_isdigit (*b)) {
+			if (!first_diff)
+				first_diff = *a - *b;
+			a++;
+			b++;
+		}
+
+		if (a < a_end && g_ascii_isdigit (*a))
+			return 1;
+		if (b < b_end && g_ascii_isdigit (*b))
+			return -1;
+		if (first_diff)
+			return first_diff;
+	}
+
+	return 0;
+}
+
+static void
+version_split (const gchar  *v,
+               gsize         len,
+               guint64      *epoch,
+               const gchar **upstream,
+               const gchar **upstream_end,
+               const gchar **revision)
+{
+	const gchar *end = v + len;
+	const gchar *colon, *p;
+
+	*epoch = 0;
+	colon = memchr (v, ':', len);
+	if (colon) {
+		for (p = v; p < colon && g_ascii_isdigit (*p); p++)
+			*epoch = *epoch * 10 + (*p - '0');
+		v = colon + 1;
+	}
+
+	*upstream = v;
+	*upstream_end = end;
+	*revision = end;
+	for (p = end; p > v; p--) {
+		if (p[-1] == '-') {
+			*upstream_end = p - 1;
+			*revision = p;
+			break;
+		}
+	}
+}
+
+static gint
+version_compare (const gchar *a, gsize a_len, const gchar *b, gsize b_len)
+{
+	guint64 a_epoch, b_epoch;
+	const gchar *a_up, *a_up_end, *a_rev;
+	const gchar *b_up, *b_up_end, *b_rev;
+	gint ret;
+
+	version_split (a, a_len, &a_epoch, &a_up, &a_up_end, &a_rev);
+	version_split (b, b_len, &b_epoch, &b_up, &b_up_end, &b_rev);
+
+	if (a_epoch != b_epoch)
+		return (a_epoch > b_epoch) ? 1 : -1;
+
+	ret = verrevcmp (a_up, a_up_end, b_up, b_up_end);
+	if (ret)
+		return ret;
+
+	return verrevcmp (a_rev, a + a_len, b_rev, b + b_len);
+}
+
+static gboolean
+status_is_installed (const Field *status)
+{
+	const gchar *state;
+
+	if (!status->ptr || status->len == 0)
+		return FALSE;
+
+	/* "want flag state" */
+	for (state = status->ptr + status->len; state > status->ptr; state--) {
+		if (state[-1] == ' ')
+			break;
+	}
+
+	return !(status->ptr + status->len - state == 13 && memcmp (state, "not-installed", 13) == 0) &&
+           !(status->ptr + status->len - state == 12 && memcmp (state, "config-files", 12) == 0);
+}
+
+static void
+package_key (GString *key, const Field *name, const gchar *arch, gsize arch_len)
+{
+	g_string_truncate (key, 0);
+	g_string_append_len (key, name->ptr, name->len);
+	g_string_append_c (key, ':');
+	g_string_append_len (key, arch, arch_len);
+}
+
+/* Returns the installed packages keyed by "name:arch" and the native
+ * architecture, taken from dpkg itself. */
+static GHashTable *
+installed_packages_load (gchar **native_arch)
+{
+	GMappedFile *file;
+	GHashTable *packages;
+	GString *key;
+	const gchar *p, *end;
+
+	file = g_mapped_file_new (DPKG_STATUS_FILE, FALSE, NULL);
+	if (!file)
+		return NULL;
+
+	packages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, package_free);
+	key = g_string_new (NULL);
+
+	p = g_mapped_file_get_contents (file);
+	end = p + g_mapped_file_get_length (file);
+
+	while (p && p < end) {
+		Stanza st;
+		Package *pkg;
+
+		p = stanza_parse (p, end, &st);
+
+		if (!st.package.ptr || !st.version.ptr || !st.arch.ptr)
+			continue;
+		if (!status_is_installed (&st.status))
+			continue;
+
+		if (!*native_arch && field_equal (&st.package, "dpkg"))
+			*native_arch = g_strndup (st.arch.ptr, st.arch.len);
+
+		pkg = g_new0 (Package, 1);
+		pkg->version = g_strndup (st.version.ptr, st.version.len);
+		pkg->version_priority = PRIORITY_INSTALLED;
+
+		package_key (key, &st.package, st.arch.ptr, st.arch.len);
+		g_hash_table_replace (packages, g_strdup (key->str), pkg);
+	}
+
+	g_string_free (key, TRUE);
+	g_mapped_file_unref (file);
+
+	return packages;
+}
+
+static gint
+release_priority (const gchar *path)
+{
+	GMappedFile *file;
+	const gchar *p, *end;
+	gboolean not_automatic = FALSE, but_automatic = FALSE;
+
+	file = g_mapped_file_new (path, FALSE, NULL);
+	if (!file)
+		return PRIORITY_DEFAULT;
+
+	p = g_mapped_file_get_contents (file);
+	end = p + g_mapped_file_get_length (file);
+
+	while (p && p < end) {
+		const gchar *eol = memchr (p, '\n', end - p);
+		if (!eol)
+			eol = end;
+
+		if (eol - p >= 17 && memcmp (p, "NotAutomatic: yes", 17) == 0)
+			not_automatic = TRUE;
+		else if (eol - p >= 25 && memcmp (p, "ButAutomaticUpgrades: yes", 25) == 0)
+			but_automatic = TRUE;
+
+		p = (eol < end) ? eol + 1 : end;
+	}
+
+	g_mapped_file_unref (file);
+
+	if (not_automatic)
+		return but_automatic ? PRIORITY_BUT_AUTOMATIC : PRIORITY_NOT_AUTOMATIC;
+
+	return PRIORITY_DEFAULT;
+}
+
+static Package *
+package_lookup (GHashTable  *packages,
+                GString     *key,
+                const Field *name,
+                const Field *arch,
+                const gchar *native_arch)
+{
+	Package *pkg;
+
+	package_key (key, name, arch->ptr, arch->len);
+	pkg = g_hash_table_lookup (packages, key->str);
+	if (pkg || !native_arch)
+		return pkg;
+
+	/* a package may move between "all" and the native architecture */
+	if (field_equal (arch, "all"))
+		package_key (key, name, native_arch, strlen (native_arch));
+	else if (field_equal (arch, native_arch))
+		package_key (key, name, "all", 3);
+	else
+		return NULL;
+
+	return g_hash_table_lookup (packages, key->str);
+}
+
+static void
+packages_index_scan (GHashTable  *packages,
+                     const gchar *path,
+                     gint         priority,
+                     const gchar *native_arch)
+{
+	GMappedFile *file;
+	GString *key;
+	const gchar *p, *end;
+
+	file = g_mapped_file_new (path, FALSE, NULL);
+	if (!file)
+		return;
+
+	key = g_string_new (NULL);
+
+	p = g_mapped_file_get_contents (file);
+	end = p + g_mapped_file_get_length (file);
+
+	while (p && p < end) {
+		Stanza st;
+		Package *pkg;
+		gint cmp;
+
+		p = stanza_parse (p, end, &st);
+
+		if (!st.package.ptr || !st.version.ptr || !st.arch.ptr)
+			continue;
+
+		pkg = package_lookup (packages, key, &st.package, &st.arch, native_arch);
+		if (!pkg)
+			continue;
+
+		cmp = version_compare (st.version.ptr, st.version.len, pkg->version, strlen (pkg->version));
+		if (cmp == 0) {
+			pkg->version_priority = MAX (pkg->version_priority, priority);
+			continue;
+		}
+		if (cmp < 0)
+			continue;
+
+		if (pkg->candidate) {
+			if (priority < pkg->candidate_priority)
+				continue;
+			if (priority == pkg->candidate_priority &&
+                version_compare (st.version.ptr, st.version.len,
+                                 pkg->candidate, strlen (pkg->candidate)) <= 0)
+				continue;
+		}
+
+		g_free (pkg->candidate);
+		g_free (pkg->source);
+		pkg->candidate = g_strndup (st.version.ptr, st.version.len);
+		pkg->candidate_priority = priority;
+
+		/* "Source: name (version)" */
+		if (st.source.ptr && st.source.len > 0) {
+			const gchar *sp = memchr (st.source.ptr, ' ', st.source.len);
+			pkg->source = g_strndup (st.source.ptr, sp ? (gsize)(sp - st.source.ptr) : st.source.len);
+		} else {
+			pkg->source = g_strndup (st.package.ptr, st.package.len);
+		}
+	}
+
+	g_string_free (key, TRUE);
+	g_mapped_file_unref (file);
+}
+
+static void
+apt_lists_scan (GHashTable *packages, const gchar *native_arch)
+{
+	GDir *dir;
+	const gchar *name;
+	GPtrArray *releases, *indices;
+	guint i, j;
+
+	dir = g_dir_open (APT_LISTS_DIR, 0, NULL);
+	if (!dir)
+		return;
+
+	releases = g_ptr_array_new_with_free_func (g_free);
+	indices = g_ptr_array_new_with_free_func (g_free);
+
+	while ((name = g_dir_read_name (dir))) {
+		if (g_str_has_suffix (name, "_Packages"))
+			g_ptr_array_add (indices, g_strdup (name));
+		else if (g_str_has_suffix (name, "_InRelease") || g_str_has_suffix (name, "_Release"))
+			g_ptr_array_add (releases, g_strdup (name));
+	}
+	g_dir_close (dir);
+
+	for (i = 0; i < indices->len; i++) {
+		const gchar *index = g_ptr_array_index (indices, i);
+		const gchar *release = NULL;
+		gsize release_len = 0;
+		gint priority = PRIORITY_DEFAULT;
+		gchar *path;
+
+		/* "<site>_dists_<suite>_InRelease" goes with
+		 * "<site>_dists_<suite>_<component>_binary-<arch>_Packages" */
+		for (j = 0; j < releases->len; j++) {
+			const gchar *r = g_ptr_array_index (releases, j);
+			gsize len = strrchr (r, '_') - r + 1;
+
+			if (len > release_len && strncmp (index, r, len) == 0) {
+				release = r;
+				release_len = len;
+			}
+		}
+
+		if (release) {
+			path = g_build_filename (APT_LISTS_DIR, release, NULL);
+			priority = release_priority (path);
+			g_free (path);
+		}
+
+		path = g_build_filename (APT_LISTS_DIR, index, NULL);
+		packages_index_scan (packages, path, priority, native_arch);
+		g_free (path);
+	}
+
+	g_ptr_array_free (releases, TRUE);
+	g_ptr_array_free (indices, TRUE);
+}
+
+static gint
+count_upgradable_sources (GHashTable *packages)
+{
+	GHashTable *sources;
+	GHashTableIter iter;
+	gpointer value;
+	gint count;
+
+	sources = g_hash_table_new (g_str_hash, g_str_equal);
+
+	g_hash_table_iter_init (&iter, packages);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		Package *pkg = value;
+
+		if (pkg->candidate && pkg->candidate_priority >= pkg->version_priority)
+			g_hash_table_add (sources, pkg->source);
+	}
+
+	count = g_hash_table_size (sources);
+	g_hash_table_destroy (sources);
+
+	return count;
+}
+
+int
+main (int argc, char **argv)
+{
+	GHashTable *packages;
+	gchar *native_arch = NULL;
+	gint count = -1;
+
+	packages = installed_packages_load (&native_arch);
+	if (packages) {
+		apt_lists_scan (packages, native_arch);
+		count = count_upgradable_sources (packages);
+		g_hash_table_destroy (packages);
+	}
+
+	g_print ("packages=%d\n", count);
+
+	g_free (native_arch);
+
+	return 0;
+}
@@ -41,6 +41,9 @@ struct _SettingsWindowPrivate
 	GtkWidget *lbl_client_crt;
 	GtkWidget *btn_gms_settings;
 	GtkWidget *chk_adn;
+
+	guint agent_unit_watch_id;
+	gboolean service_control_pending;
 };
 
 
@@ -63,7 +66,15 @@ child_watch_func (GPid     pid,
 
 	g_spawn_close_pid (pid);
 
+	/* what was asked for, before the refresh below can move the switch */
+	switch_active = gtk_switch_get_active (GTK_SWITCH (priv->swt_service));
+
+	/* the change signal may still be queued behind the child's exit;
+	 * service_control_pending keeps the watcher off the switch */
+	systemd_unit_refresh (GOOROOM_AGENT_SERVICE_NAME);
+
 	if (!is_systemd_service_available (GOOROOM_AGENT_SERVICE_NAME)) {
+		priv->service_control_pending = FALSE;
 		gtk_widget_set_sensitive (priv->swt_service, FALSE);
 		gtk_switch_set_active (GTK_SWITCH (priv->swt_service), FALSE);
 		return;
@@ -72,12 +83,13 @@ child_watch_func (GPid     pid,
 	gtk_widget_set_sensitive (priv->swt_service, TRUE);
 
 	service_active = is_systemd_service_active (GOOROOM_AGENT_SERVICE_NAME);
-	switch_active = gtk_switch_get_active (GTK_SWITCH (priv->swt_service));
 
 	g_signal_handlers_block_by_func (priv->swt_service, on_service_state_changed, window);
 	gtk_switch_set_active (GTK_SWITCH (priv->swt_service), service_active);
 	g_signal_handlers_unblock_by_func (priv->swt_service, on_service_state_changed, window);
 
+	priv->service_control_pending = FALSE;
+
 	if (switch_active == service_active) {
 		const gchar *message = (service_active) ? _("Service was started successfully") : _("Service was stopped successfully");
 
@@ -107,6 +119,7 @@ gooroom_agent_service_control (gpointer data)
 	GError *error = NULL;
 
 	gtk_widget_set_sensitive (GTK_WIDGET (priv->swt_service), FALSE);
+	priv->service_control_pending = TRUE;
 
 	if (gtk_switch_get_active (GTK_SWITCH (priv->swt_service)))
 		cmd = g_strdup_printf ("pkexec %s -s %s -a", GOOROOM_SYSTEMD_CONTROL_HELPER, GOOROOM_AGENT_SERVICE_NAME);
@@ -165,6 +178,18 @@ gooroom_agent_service_status_update (gpointer data)
 	return FALSE;
 }
 
+static void
+agent_unit_changed_cb (const gchar *unit_name, gpointer data)
+{
+	SettingsWindow *window = SETTINGS_WINDOW (data);
+
+	/* child_watch_func () reports on the change we asked for */
+	if (window->priv->service_control_pending)
+		return;
+
+	gooroom_agent_service_status_update (window);
+}
+
 static void
 on_allow_duplicate_notification_toggled (GtkToggleButton *button,
                                          gpointer         data)
@@ -351,6 +376,8 @@ settings_window_finalize (GObject *object)
 	SettingsWindow *window = SETTINGS_WINDOW (object);
 	SettingsWindowPrivate *priv = window->priv;
 
+	systemd_unit_watch_remove (priv->agent_unit_watch_id);
+
 	if (priv->settings) {
 		g_object_unref (priv->settings);
 	}
@@ -367,6 +394,8 @@ settings_window_init (SettingsWindow *self)
 	priv = self->priv = settings_window_get_instance_private (self);
 
 	priv->settings = NULL;
+	priv->agent_unit_watch_id = 0;
+	priv->service_control_pending = FALSE;
 
 	gtk_widget_init_template (GTK_WIDGET (self));
 
@@ -380,6 +409,9 @@ settings_window_init (SettingsWindow *self)
 	update_ui (self);
     accel_init (self);
 
+	priv->agent_unit_watch_id = systemd_unit_watch_add (GOOROOM_AGENT_SERVICE_NAME,
+                                                        agent_unit_changed_cb, self);
+
 	g_signal_connect (G_OBJECT (priv->swt_service), "state-set",
                       G_CALLBACK (on_service_state_changed), self);
 
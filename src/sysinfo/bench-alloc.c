@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Counts heap use for the benchmarks by interposing malloc and friends
+ * on glibc's own entry points, so allocations made inside GLib count
+ * too.  The benchmarks are single threaded; the counters are not
+ * atomic.
+ */
+
+#include "bench-alloc.h"
+
+#ifdef __GLIBC__
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t nmemb, size_t size);
+extern void *__libc_realloc  (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void  __libc_free     (void *ptr);
+
+static guint64 n_allocs = 0;
+static gssize  live = 0;
+static gssize  peak = 0;
+static gssize  base = 0;
+
+
+static void *
+account (void *ptr)
+{
+	if (ptr) {
+		n_allocs++;
+		live += malloc_usable_size (ptr);
+		if (live > peak)
+			peak = live;
+	}
+
+	return ptr;
+}
+
+void *
+malloc (size_t size)
+{
+	return account (__libc_malloc (size));
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	return account (__libc_calloc (nmemb, size));
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	void *new_ptr;
+	gssize old_size = ptr ? malloc_usable_size (ptr) : 0;
+
+	new_ptr = __libc_realloc (ptr, size);
+	if (new_ptr || size == 0)
+		live -= old_size;
+
+	return account (new_ptr);
+}
+
+void
+free (void *ptr)
+{
+	if (ptr)
+		live -= malloc_usable_size (ptr);
+
+	__libc_free (ptr);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+	return account (__libc_memalign (alignment, size));
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+	return account (__libc_memalign (alignment, size));
+}
+
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment % sizeof (void *) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	ptr = account (__libc_memalign (alignment, size));
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+void
+bench_alloc_reset (void)
+{
+	n_allocs = 0;
+	base = peak = live;
+}
+
+void
+bench_alloc_get (BenchAllocStats *stats)
+{
+	stats->count = n_allocs;
+	stats->peak = peak - base;
+}
+
+#else
+
+void
+bench_alloc_reset (void)
+{
+}
+
+void
+bench_alloc_get (BenchAllocStats *stats)
+{
+	stats->count = 0;
+	stats->peak = 0;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _BENCH_ALLOC_H_
+#define _BENCH_ALLOC_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Heap use since the last bench_alloc_reset(), as seen by malloc and
+ * friends.  Only counted with glibc; elsewhere everything reads 0. */
+typedef struct {
+	guint64 count;   /* allocations made */
+	gsize   peak;    /* highest number of live bytes above the start */
+} BenchAllocStats;
+
+
+void     bench_alloc_reset (void);
+void     bench_alloc_get   (BenchAllocStats *stats);
+
+G_END_DECLS
+
+#endif /* _BENCH_ALLOC_H_ */
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmarks the firewall code on synthetic "iptables-save -c" and
+ * "ip6tables-save -c" dumps: parsing with firewall_ruleset_parse() and
+ * indexing with firewall_rule_model_set_ruleset().  Reports rules per
+ * second and the peak heap use of each step, and fails if a dump does
+ * not come back with the rules it was made of.
+ */
+
+#include "bench-alloc.h"
+#include "firewall-ruleset.h"
+#include "firewall-rule-model.h"
+
+#include <stdlib.h>
+
+
+#define BENCH_MIN_TIME    200000 /* usec spent on each measurement */
+
+static const guint sizes[] = { 100, 10000, 100000 };
+
+static const gchar *chains[] = { "INPUT", "OUTPUT", "FORWARD", "LOGDROP" };
+static const gchar *targets[] = { "ACCEPT", "DROP", "REJECT --reject-with icmp-port-unreachable", "LOGDROP" };
+
+
+static void
+append_address (GString *dump, gboolean ipv6, guint i, guint plen)
+{
+	if (ipv6)
+		g_string_append_printf (dump, "2001:db8:%x:%x::/%u", (i >> 16) & 0xffff, i & 0xffff, plen);
+	else
+		g_string_append_printf (dump, "10.%u.%u.%u/%u", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff, plen);
+}
+
+/* @n_rules rules of the filter table, in the shapes iptables-save writes */
+static GBytes *
+dump_new (gboolean ipv6, guint n_rules)
+{
+	guint i;
+	GString *dump = g_string_new (NULL);
+
+	g_string_append_printf (dump, "# Generated by %s-save v1.8.7 on Thu Jan  1 00:00:00 2026\n",
+                            ipv6 ? "ip6tables" : "iptables");
+	g_string_append (dump, "*filter\n"
+                           ":INPUT DROP [1024:65536]\n"
+                           ":FORWARD DROP [0:0]\n"
+                           ":OUTPUT ACCEPT [2048:131072]\n"
+                           ":LOGDROP - [0:0]\n");
+
+	for (i = 0; i < n_rules; i++) {
+		g_string_append_printf (dump, "[%u:%u] -A %s ", i % 97, (i % 97) * 60, chains[i % G_N_ELEMENTS (chains)]);
+
+		if (i % 11 == 0)
+			g_string_append (dump, "! ");
+		g_string_append (dump, "-s ");
+		append_address (dump, ipv6, i, ipv6 ? (i % 3 ? 128 : 64) : (i % 3 ? 32 : 24));
+
+		if (i % 5 == 0) {
+			g_string_append (dump, " -d ");
+			append_address (dump, ipv6, i * 7, ipv6 ? 48 : 16);
+		}
+
+		if (i % 2 == 0)
+			g_string_append_printf (dump, " -i eth%u -p tcp -m tcp --dport %u", i % 4, 1 + i % 65535);
+		else
+			g_string_append (dump, " -p udp -m udp --sport 53 -m comment --comment \"dns \\\"reply\\\"\"");
+
+		g_string_append_printf (dump, " -j %s\n", targets[i % G_N_ELEMENTS (targets)]);
+	}
+
+	g_string_append (dump, "COMMIT\n");
+
+	return g_string_free_to_bytes (dump);
+}
+
+static gboolean
+ruleset_check (FirewallRuleset *ruleset, guint n_rules)
+{
+	guint i;
+
+	if (firewall_ruleset_get_n_rules (ruleset) != n_rules ||
+        firewall_ruleset_get_n_chains (ruleset) != 4)
+		return FALSE;
+
+	for (i = 0; i < n_rules; i++) {
+		const FirewallRule *rule = firewall_ruleset_get_rule (ruleset, i);
+
+		if (!firewall_slice_equal (&rule->table, "filter") ||
+            !firewall_slice_equal (&rule->chain, chains[i % G_N_ELEMENTS (chains)]) ||
+            rule->packets != i % 97 ||
+            !rule->source.str ||
+            ((rule->flags & FIREWALL_RULE_NOT_SOURCE) != 0) != (i % 11 == 0) ||
+            (rule->destination.str != NULL) != (i % 5 == 0) ||
+            !firewall_slice_equal (&rule->protocol, (i % 2 == 0) ? "tcp" : "udp"))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+report (const gchar *step, gboolean ipv6, guint n_rules, gint64 usec, guint runs,
+        const BenchAllocStats *stats)
+{
+	gdouble seconds = (gdouble) usec / G_USEC_PER_SEC / runs;
+
+	g_print ("%-6s %-4s %7u rules %10.3f ms %10.0f rules/s %10.1f KiB peak %8" G_GUINT64_FORMAT " allocs\n",
+             step, ipv6 ? "ipv6" : "ipv4", n_rules, seconds * 1000,
+             n_rules / seconds, stats->peak / 1024.0, stats->count);
+}
+
+static gboolean
+bench_parse (GBytes *dump, gboolean ipv6, guint n_rules)
+{
+	guint runs = 0;
+	gint64 start, usec;
+	gboolean valid;
+	BenchAllocStats stats;
+	FirewallRuleset *ruleset;
+
+	bench_alloc_reset ();
+	ruleset = firewall_ruleset_parse (dump);
+	bench_alloc_get (&stats);
+
+	valid = ruleset_check (ruleset, n_rules);
+	firewall_ruleset_free (ruleset);
+
+	if (!valid) {
+		g_printerr ("%s dump of %u rules parsed wrongly\n", ipv6 ? "ipv6" : "ipv4", n_rules);
+		return FALSE;
+	}
+
+	start = g_get_monotonic_time ();
+	do {
+		firewall_ruleset_free (firewall_ruleset_parse (dump));
+		runs++;
+		usec = g_get_monotonic_time () - start;
+	} while (usec < BENCH_MIN_TIME);
+
+	report ("parse", ipv6, n_rules, usec, runs, &stats);
+
+	return TRUE;
+}
+
+static gboolean
+bench_index (GBytes *dump, gboolean ipv6, guint n_rules)
+{
+	guint runs = 0;
+	gint64 begin, start, usec = 0;
+	gboolean valid;
+	BenchAllocStats stats;
+	FirewallRuleModel *model;
+
+	/* the parse is not part of it; the model frees the last ruleset */
+	model = firewall_rule_model_new ();
+	begin = g_get_monotonic_time ();
+
+	do {
+		FirewallRuleset *ruleset = firewall_ruleset_parse (dump);
+
+		/* an empty model each time, as on startup */
+		firewall_rule_model_set_ruleset (model, firewall_ruleset_parse (NULL));
+
+		if (runs == 0)
+			bench_alloc_reset ();
+
+		start = g_get_monotonic_time ();
+		firewall_rule_model_set_ruleset (model, ruleset);
+		usec += g_get_monotonic_time () - start;
+
+		if (runs == 0)
+			bench_alloc_get (&stats);
+
+		runs++;
+	} while (g_get_monotonic_time () - begin < BENCH_MIN_TIME);
+
+	valid = (firewall_rule_model_get_n_rules (model) == n_rules &&
+             gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL) == (gint) n_rules);
+
+	g_object_unref (model);
+
+	if (!valid) {
+		g_printerr ("%s ruleset of %u rules indexed wrongly\n", ipv6 ? "ipv6" : "ipv4", n_rules);
+		return FALSE;
+	}
+
+	report ("index", ipv6, n_rules, usec, runs, &stats);
+
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i, ipv6;
+	gboolean passed = TRUE;
+
+	for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+		for (ipv6 = 0; ipv6 <= 1; ipv6++) {
+			GBytes *dump = dump_new (ipv6, sizes[i]);
+
+			if (!bench_parse (dump, ipv6, sizes[i]) ||
+                !bench_index (dump, ipv6, sizes[i]))
+				passed = FALSE;
+
+			g_bytes_unref (dump);
+		}
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
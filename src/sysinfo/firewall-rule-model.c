@@ -0,0 +1,1299 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "firewall-rule-model.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+
+
+#define NO_ENTRY      G_MAXUINT32
+#define NO_ID         G_MAXUINT32
+
+enum {
+	FIELD_SOURCE,
+	FIELD_DESTINATION,
+	N_FIELDS
+};
+
+enum {
+	FAMILY_IPV4,
+	FAMILY_IPV6,
+	N_FAMILIES
+};
+
+/*
+ * An entry is a rule of the filter table, numbered in dump order; the
+ * ruleset itself holds the rule text.  Chains and targets are interned
+ * and each id maps to the ascending list of its entries.
+ *
+ * Source and destination prefixes go into path compressed binary tries,
+ * one per field and address family.  Each node is a prefix and lists
+ * the entries whose address is exactly that prefix; an absent address
+ * is the zero length prefix at the root.  An address query walks the
+ * path of the queried prefix, taking every entry on the way (rules whose
+ * prefix contains it) and the whole subtree where the path ends (rules
+ * inside a queried network).  Negated addresses and non-contiguous
+ * masks cannot live in a trie and are checked one by one.
+ */
+typedef struct {
+	guint8  key[16];
+	guint8  plen;
+	guint32 child[2];
+	guint32 head;
+} TrieNode;
+
+typedef struct {
+	GArray *nodes;
+	GArray *next;
+} CidrTrie;
+
+typedef struct {
+	guint32  entry;
+	guint8   field;
+	guint8   family;
+	gboolean negated;
+	guint8   key[16];
+	guint8   mask[16];
+} LinearMatch;
+
+struct _FirewallRuleModelPrivate {
+	gint             stamp;
+
+	FirewallRuleset *ruleset;
+
+	GArray          *rules;       /* entry -> rule index in the ruleset */
+	GArray          *chain_ids;
+	GArray          *target_ids;
+
+	GPtrArray       *chains;      /* id -> name */
+	GPtrArray       *targets;
+	GHashTable      *chain_lookup;  /* name -> id + 1 */
+	GHashTable      *target_lookup;
+	GPtrArray       *chain_postings;  /* id -> GArray of entries */
+	GPtrArray       *target_postings;
+
+	CidrTrie         tries[N_FIELDS][N_FAMILIES];
+	GArray          *linear;
+
+	GArray          *rows;        /* a gap buffer while being edited */
+	guint            gap_start;
+	guint            gap_len;
+	GByteArray      *matched;
+
+	gchar           *filter_chain;
+	gchar           *filter_target;
+	gchar           *filter_address;
+};
+
+
+static void firewall_rule_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FirewallRuleModel, firewall_rule_model, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (FirewallRuleModel)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, firewall_rule_model_tree_model_init))
+
+
+#define N_ROWS(priv)         ((priv)->rows->len - (priv)->gap_len)
+#define ROW_ENTRY(priv,pos)  (g_array_index ((priv)->rows, guint32, \
+                              (pos) < (priv)->gap_start ? (pos) : (pos) + (priv)->gap_len))
+#define ENTRY_RULE(priv,entry) \
+	(firewall_ruleset_get_rule ((priv)->ruleset, g_array_index ((priv)->rules, guint32, (entry))))
+
+#define KEY_BIT(key,i)       (((key)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+
+static guint
+prefix_common (const guint8 *a, const guint8 *b, guint max)
+{
+	guint i = 0;
+
+	while (i + 8 <= max && a[i >> 3] == b[i >> 3])
+		i += 8;
+
+	while (i < max && KEY_BIT (a, i) == KEY_BIT (b, i))
+		i++;
+
+	return i;
+}
+
+static guint32
+trie_node_new (CidrTrie *trie, const guint8 *key, guint plen)
+{
+	TrieNode node;
+	guint i;
+
+	memset (&node, 0, sizeof (TrieNode));
+	node.plen = plen;
+	node.head = NO_ENTRY;
+
+	for (i = 0; i < plen; i++) {
+		if (KEY_BIT (key, i))
+			node.key[i >> 3] |= 1 << (7 - (i & 7));
+	}
+
+	g_array_append_val (trie->nodes, node);
+
+	return trie->nodes->len - 1;
+}
+
+static void
+trie_init (CidrTrie *trie)
+{
+	static const guint8 zero[16] = { 0, };
+
+	trie->nodes = g_array_new (FALSE, FALSE, sizeof (TrieNode));
+	trie->next = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	trie_node_new (trie, zero, 0);
+}
+
+static void
+trie_clear (CidrTrie *trie)
+{
+	g_array_free (trie->nodes, TRUE);
+	g_array_free (trie->next, TRUE);
+}
+
+#define NODE(trie,i) (&g_array_index ((trie)->nodes, TrieNode, (i)))
+
+static void
+trie_node_add (CidrTrie *trie, guint32 node, guint32 entry)
+{
+	guint32 none = NO_ENTRY;
+
+	while (trie->next->len <= entry)
+		g_array_append_val (trie->next, none);
+
+	g_array_index (trie->next, guint32, entry) = NODE (trie, node)->head;
+	NODE (trie, node)->head = entry;
+}
+
+static void
+trie_insert (CidrTrie *trie, const guint8 *key, guint plen, guint32 entry)
+{
+	guint32 node = 0;
+
+	for (;;) {
+		guint bit, common;
+		guint32 child, mid, leaf;
+
+		if (NODE (trie, node)->plen == plen) {
+			trie_node_add (trie, node, entry);
+			return;
+		}
+
+		bit = KEY_BIT (key, NODE (trie, node)->plen);
+		child = NODE (trie, node)->child[bit];
+		if (!child) {
+			leaf = trie_node_new (trie, key, plen);
+			NODE (trie, node)->child[bit] = leaf;
+			trie_node_add (trie, leaf, entry);
+			return;
+		}
+
+		common = prefix_common (key, NODE (trie, child)->key, MIN (plen, NODE (trie, child)->plen));
+		if (common == NODE (trie, child)->plen) {
+			node = child;
+			continue;
+		}
+
+		/* the key leaves the child's path at 'common' */
+		mid = trie_node_new (trie, key, common);
+		NODE (trie, mid)->child[KEY_BIT (NODE (trie, child)->key, common)] = child;
+		NODE (trie, node)->child[bit] = mid;
+
+		if (common == plen) {
+			trie_node_add (trie, mid, entry);
+		} else {
+			leaf = trie_node_new (trie, key, plen);
+			NODE (trie, mid)->child[KEY_BIT (key, common)] = leaf;
+			trie_node_add (trie, leaf, entry);
+		}
+		return;
+	}
+}
+
+static void
+trie_mark_node (CidrTrie *trie, guint32 node, guint8 *matched)
+{
+	guint32 entry;
+
+	for (entry = NODE (trie, node)->head; entry != NO_ENTRY;
+         entry = g_array_index (trie->next, guint32, entry))
+		matched[entry] = TRUE;
+}
+
+static void
+trie_mark_subtree (CidrTrie *trie, guint32 node, guint8 *matched)
+{
+	GArray *stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	g_array_append_val (stack, node);
+
+	while (stack->len > 0) {
+		guint i;
+
+		node = g_array_index (stack, guint32, stack->len - 1);
+		g_array_set_size (stack, stack->len - 1);
+
+		trie_mark_node (trie, node, matched);
+
+		for (i = 0; i < 2; i++) {
+			if (NODE (trie, node)->child[i])
+				g_array_append_val (stack, NODE (trie, node)->child[i]);
+		}
+	}
+
+	g_array_free (stack, TRUE);
+}
+
+/* Marks the entries whose prefix contains or lies inside key/plen. */
+static void
+trie_lookup (CidrTrie *trie, const guint8 *key, guint plen, guint8 *matched)
+{
+	guint32 node = 0;
+
+	for (;;) {
+		guint common;
+		guint32 child;
+
+		if (NODE (trie, node)->plen == plen) {
+			trie_mark_subtree (trie, node, matched);
+			return;
+		}
+
+		trie_mark_node (trie, node, matched);
+
+		child = NODE (trie, node)->child[KEY_BIT (key, NODE (trie, node)->plen)];
+		if (!child)
+			return;
+
+		common = prefix_common (key, NODE (trie, child)->key, MIN (plen, NODE (trie, child)->plen));
+		if (common == NODE (trie, child)->plen) {
+			node = child;
+		} else {
+			if (common == plen)
+				trie_mark_subtree (trie, child, matched);
+			return;
+		}
+	}
+}
+
+static void
+mask_from_plen (guint8 *mask, guint plen)
+{
+	guint i;
+
+	memset (mask, 0, 16);
+	for (i = 0; i < plen; i++)
+		mask[i >> 3] |= 1 << (7 - (i & 7));
+}
+
+/* Parses "addr", "addr/len" or "addr/mask".  Returns the family, or -1.
+ * @plen is set to -1 for a non-contiguous mask. */
+static gint
+address_parse (const gchar *str, gsize len, guint8 *key, guint8 *mask, gint *plen)
+{
+	gchar buf[INET6_ADDRSTRLEN * 2 + 2];
+	gchar *slash;
+	gint family, bits, i;
+
+	if (len == 0 || len >= sizeof (buf))
+		return -1;
+
+	memcpy (buf, str, len);
+	buf[len] = '\0';
+
+	slash = strchr (buf, '/');
+	if (slash)
+		*slash++ = '\0';
+
+	memset (key, 0, 16);
+	if (inet_pton (AF_INET, buf, key) == 1) {
+		family = FAMILY_IPV4;
+		bits = 32;
+	} else if (inet_pton (AF_INET6, buf, key) == 1) {
+		family = FAMILY_IPV6;
+		bits = 128;
+	} else {
+		return -1;
+	}
+
+	*plen = bits;
+
+	if (slash && strchr (slash, family == FAMILY_IPV4 ? '.' : ':')) {
+		if (inet_pton (family == FAMILY_IPV4 ? AF_INET : AF_INET6, slash, mask) != 1)
+			return -1;
+
+		/* a contiguous mask is a prefix length */
+		for (i = 0; i < bits && KEY_BIT (mask, i); i++);
+		*plen = i;
+		for (; i < bits; i++) {
+			if (KEY_BIT (mask, i)) {
+				*plen = -1;
+				break;
+			}
+		}
+	} else if (slash) {
+		gchar *end;
+		gint64 value = g_ascii_strtoll (slash, &end, 10);
+
+		if (*end != '\0' || value < 0 || value > bits)
+			return -1;
+
+		*plen = value;
+	}
+
+	if (*plen >= 0)
+		mask_from_plen (mask, *plen);
+
+	for (i = 0; i < 16; i++)
+		key[i] &= mask[i];
+
+	return family;
+}
+
+static gboolean
+linear_match (const LinearMatch *match, gint family, const guint8 *key, guint plen)
+{
+	guint8 mask[16];
+	gboolean inside = TRUE;
+	guint i;
+
+	/* a rule of the other family does not match, negated or not */
+	if (match->family != family)
+		return FALSE;
+
+	/* the queried prefix lies inside the rule's network */
+	mask_from_plen (mask, plen);
+	for (i = 0; i < 16; i++) {
+		if ((match->mask[i] & ~mask[i]) ||
+            (key[i] & match->mask[i]) != match->key[i]) {
+			inside = FALSE;
+			break;
+		}
+	}
+
+	return match->negated ? !inside : inside;
+}
+
+static guint32
+intern (GPtrArray *names, GHashTable *lookup, GPtrArray *postings, const FirewallSlice *slice, guint32 entry)
+{
+	gchar *name = firewall_slice_dup (slice);
+	guint32 id = GPOINTER_TO_UINT (g_hash_table_lookup (lookup, name));
+
+	if (id == 0) {
+		g_ptr_array_add (names, name);
+		g_ptr_array_add (postings, g_array_new (FALSE, FALSE, sizeof (guint32)));
+		id = names->len;
+		g_hash_table_insert (lookup, name, GUINT_TO_POINTER (id));
+	} else {
+		g_free (name);
+	}
+
+	g_array_append_val (g_ptr_array_index (postings, id - 1), entry);
+
+	return id - 1;
+}
+
+static void
+index_address (FirewallRuleModelPrivate *priv,
+               guint                     field,
+               const FirewallSlice      *address,
+               gboolean                  negated,
+               guint32                   entry)
+{
+	static const guint8 anywhere[16] = { 0, };
+	LinearMatch match;
+	gint family, plen;
+
+	if (!address->str) {
+		trie_insert (&priv->tries[field][FAMILY_IPV4], anywhere, 0, entry);
+		trie_insert (&priv->tries[field][FAMILY_IPV6], anywhere, 0, entry);
+		return;
+	}
+
+	family = address_parse (address->str, address->len, match.key, match.mask, &plen);
+	if (family < 0)
+		return;
+
+	if (!negated && plen >= 0) {
+		trie_insert (&priv->tries[field][family], match.key, plen, entry);
+		return;
+	}
+
+	match.entry = entry;
+	match.field = field;
+	match.family = family;
+	match.negated = negated;
+	g_array_append_val (priv->linear, match);
+}
+
+static void
+index_clear (FirewallRuleModelPrivate *priv)
+{
+	guint f, a;
+
+	g_array_set_size (priv->rules, 0);
+	g_array_set_size (priv->chain_ids, 0);
+	g_array_set_size (priv->target_ids, 0);
+	g_array_set_size (priv->linear, 0);
+
+	g_hash_table_remove_all (priv->chain_lookup);
+	g_hash_table_remove_all (priv->target_lookup);
+	g_ptr_array_set_size (priv->chains, 0);
+	g_ptr_array_set_size (priv->targets, 0);
+	g_ptr_array_set_size (priv->chain_postings, 0);
+	g_ptr_array_set_size (priv->target_postings, 0);
+
+	for (f = 0; f < N_FIELDS; f++) {
+		for (a = 0; a < N_FAMILIES; a++) {
+			trie_clear (&priv->tries[f][a]);
+			trie_init (&priv->tries[f][a]);
+		}
+	}
+}
+
+static void
+index_build (FirewallRuleModelPrivate *priv)
+{
+	guint32 i, n_rules;
+
+	if (!priv->ruleset)
+		return;
+
+	n_rules = firewall_ruleset_get_n_rules (priv->ruleset);
+	for (i = 0; i < n_rules; i++) {
+		const FirewallRule *rule = firewall_ruleset_get_rule (priv->ruleset, i);
+		guint32 entry = priv->rules->len;
+		guint32 id;
+
+		if (!firewall_slice_equal (&rule->table, "filter"))
+			continue;
+
+		g_array_append_val (priv->rules, i);
+
+		id = intern (priv->chains, priv->chain_lookup, priv->chain_postings, &rule->chain, entry);
+		g_array_append_val (priv->chain_ids, id);
+
+		id = intern (priv->targets, priv->target_lookup, priv->target_postings, &rule->target, entry);
+		g_array_append_val (priv->target_ids, id);
+
+		index_address (priv, FIELD_SOURCE, &rule->source,
+                       rule->flags & FIREWALL_RULE_NOT_SOURCE, entry);
+		index_address (priv, FIELD_DESTINATION, &rule->destination,
+                       rule->flags & FIREWALL_RULE_NOT_DESTINATION, entry);
+	}
+}
+
+static void
+set_iter (FirewallRuleModel *model, GtkTreeIter *iter, guint pos)
+{
+	iter->stamp = model->priv->stamp;
+	iter->user_data = GUINT_TO_POINTER (pos);
+}
+
+static void
+emit_row_inserted (FirewallRuleModel *model, guint pos)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+
+	set_iter (model, &iter, pos);
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_deleted (FirewallRuleModel *model, guint pos)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+	gtk_tree_path_free (path);
+}
+
+/*
+ * 'rows' is edited from the top down and the view is told of each change
+ * as it is made, so the model always matches what it has been told.  The
+ * array is a gap buffer meanwhile: the rows before gap_start are final,
+ * the old ones still to be visited start at gap_start + gap_len.
+ */
+static void
+rows_edit_begin (FirewallRuleModelPrivate *priv, guint n_inserts)
+{
+	guint n = priv->rows->len;
+
+	g_array_set_size (priv->rows, n + n_inserts);
+	if (n_inserts > 0 && n > 0)
+		memmove (priv->rows->data + n_inserts * sizeof (guint32), priv->rows->data, n * sizeof (guint32));
+
+	priv->gap_start = 0;
+	priv->gap_len = n_inserts;
+}
+
+static guint32
+rows_edit_next (FirewallRuleModelPrivate *priv)
+{
+	return g_array_index (priv->rows, guint32, priv->gap_start + priv->gap_len);
+}
+
+/* The next old row stays, as @entry. */
+static void
+rows_edit_keep (FirewallRuleModelPrivate *priv, guint32 entry)
+{
+	g_array_index (priv->rows, guint32, priv->gap_start) = entry;
+	priv->gap_start++;
+}
+
+/* The next old row goes. */
+static void
+rows_edit_delete (FirewallRuleModel *model)
+{
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	priv->gap_len++;
+	priv->stamp++;
+
+	emit_row_deleted (model, priv->gap_start);
+}
+
+/* @entry comes in before the next old row. */
+static void
+rows_edit_insert (FirewallRuleModel *model, guint32 entry)
+{
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	g_array_index (priv->rows, guint32, priv->gap_start) = entry;
+	priv->gap_start++;
+	priv->gap_len--;
+	priv->stamp++;
+
+	emit_row_inserted (model, priv->gap_start - 1);
+}
+
+static void
+rows_edit_end (FirewallRuleModelPrivate *priv)
+{
+	g_array_set_size (priv->rows, priv->gap_start);
+
+	priv->gap_start = 0;
+	priv->gap_len = 0;
+}
+
+/* Turns 'rows' into @rows, both ascending, and frees @rows. */
+static void
+set_rows (FirewallRuleModel *model, GArray *rows)
+{
+	guint i = 0, j = 0, n_old, n_inserts = 0;
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	n_old = priv->rows->len;
+
+	/* the insertions need room in the gap */
+	while (j < rows->len) {
+		guint32 o = (i < n_old) ? g_array_index (priv->rows, guint32, i) : NO_ENTRY;
+		guint32 n = g_array_index (rows, guint32, j);
+
+		if (o == n) {
+			i++; j++;
+		} else if (o < n) {
+			i++;
+		} else {
+			n_inserts++; j++;
+		}
+	}
+
+	rows_edit_begin (priv, n_inserts);
+
+	for (i = 0, j = 0; i < n_old || j < rows->len;) {
+		guint32 o = (i < n_old) ? rows_edit_next (priv) : NO_ENTRY;
+		guint32 n = (j < rows->len) ? g_array_index (rows, guint32, j) : NO_ENTRY;
+
+		if (o == n) {
+			rows_edit_keep (priv, n);
+			i++; j++;
+		} else if (o < n) {
+			rows_edit_delete (model);
+			i++;
+		} else {
+			rows_edit_insert (model, n);
+			j++;
+		}
+	}
+
+	rows_edit_end (priv);
+
+	g_array_free (rows, TRUE);
+}
+
+static guint
+rule_hash (gconstpointer rule)
+{
+	return firewall_rule_hash (rule);
+}
+
+static gboolean
+rule_equal (gconstpointer a, gconstpointer b)
+{
+	return firewall_rule_equal (a, b);
+}
+
+/* Pairs the rows shown, @old_rules, with the rows to show, @new_rules.
+ * Equal rules pair up in order; of those pairs the longest run ascending
+ * on both sides is kept, so only the rules that really came or went are
+ * deleted or inserted.  Returns the new position of each old row, or
+ * NO_ENTRY for the rows that go. */
+static GArray *
+rows_match (GPtrArray *old_rules, GPtrArray *new_rules)
+{
+	guint i;
+	guint32 pos;
+	GHashTable *heads;
+	GArray *next, *pairs, *tails, *prev, *match;
+
+	/* rule -> first unpaired new position + 1, 'next' links the others */
+	heads = g_hash_table_new (rule_hash, rule_equal);
+	next = g_array_sized_new (FALSE, FALSE, sizeof (guint32), new_rules->len);
+	g_array_set_size (next, new_rules->len);
+
+	for (i = new_rules->len; i > 0; i--) {
+		gpointer rule = g_ptr_array_index (new_rules, i - 1);
+
+		g_array_index (next, guint32, i - 1) = GPOINTER_TO_UINT (g_hash_table_lookup (heads, rule));
+		g_hash_table_insert (heads, rule, GUINT_TO_POINTER (i));
+	}
+
+	pairs = g_array_sized_new (FALSE, FALSE, sizeof (guint32), old_rules->len);
+	for (i = 0; i < old_rules->len; i++) {
+		gpointer rule = g_ptr_array_index (old_rules, i);
+		guint32 head = GPOINTER_TO_UINT (g_hash_table_lookup (heads, rule));
+
+		pos = (head > 0) ? head - 1 : NO_ENTRY;
+		g_array_append_val (pairs, pos);
+
+		if (head > 0)
+			g_hash_table_insert (heads, rule, GUINT_TO_POINTER (g_array_index (next, guint32, head - 1)));
+	}
+
+	/* longest increasing subsequence: tails[l] is the old row ending the
+	 * best run of length l + 1 found so far */
+	tails = g_array_new (FALSE, FALSE, sizeof (guint32));
+	prev = g_array_sized_new (FALSE, FALSE, sizeof (guint32), old_rules->len);
+	g_array_set_size (prev, old_rules->len);
+
+	for (i = 0; i < pairs->len; i++) {
+		guint lo = 0, hi = tails->len;
+
+		pos = g_array_index (pairs, guint32, i);
+		if (pos == NO_ENTRY)
+			continue;
+
+		while (lo < hi) {
+			guint mid = (lo + hi) / 2;
+
+			if (g_array_index (pairs, guint32, g_array_index (tails, guint32, mid)) < pos)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		g_array_index (prev, guint32, i) = (lo > 0) ? g_array_index (tails, guint32, lo - 1) : NO_ENTRY;
+		if (lo == tails->len)
+			g_array_append_val (tails, i);
+		else
+			g_array_index (tails, guint32, lo) = i;
+	}
+
+	match = g_array_sized_new (FALSE, FALSE, sizeof (guint32), old_rules->len);
+	for (i = 0; i < old_rules->len; i++) {
+		pos = NO_ENTRY;
+		g_array_append_val (match, pos);
+	}
+
+	for (pos = tails->len ? g_array_index (tails, guint32, tails->len - 1) : NO_ENTRY;
+         pos != NO_ENTRY; pos = g_array_index (prev, guint32, pos))
+		g_array_index (match, guint32, pos) = g_array_index (pairs, guint32, pos);
+
+	g_hash_table_destroy (heads);
+	g_array_free (next, TRUE);
+	g_array_free (pairs, TRUE);
+	g_array_free (tails, TRUE);
+	g_array_free (prev, TRUE);
+
+	return match;
+}
+
+static guint32
+lookup_id (GHashTable *lookup, const gchar *name)
+{
+	guint32 id = GPOINTER_TO_UINT (g_hash_table_lookup (lookup, name));
+
+	return (id == 0) ? NO_ID : id - 1;
+}
+
+/* The entries passing the filter, ascending. */
+static GArray *
+filter_rows (FirewallRuleModel *model)
+{
+	guint i, n, plen = 0;
+	gint family = -1, query_plen;
+	guint8 key[16], mask[16];
+	guint32 chain = NO_ID, target = NO_ID;
+	GArray *rows, *candidates = NULL;
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	rows = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	if (priv->filter_chain) {
+		chain = lookup_id (priv->chain_lookup, priv->filter_chain);
+		if (chain == NO_ID)
+			goto out;
+		candidates = g_ptr_array_index (priv->chain_postings, chain);
+	}
+
+	if (priv->filter_target) {
+		target = lookup_id (priv->target_lookup, priv->filter_target);
+		if (target == NO_ID)
+			goto out;
+		if (!candidates)
+			candidates = g_ptr_array_index (priv->target_postings, target);
+	}
+
+	if (priv->filter_address) {
+		family = address_parse (priv->filter_address, strlen (priv->filter_address),
+                                key, mask, &query_plen);
+		/* an address that does not parse matches nothing */
+		if (family < 0 || query_plen < 0)
+			goto out;
+
+		plen = query_plen;
+
+		g_byte_array_set_size (priv->matched, priv->rules->len);
+		memset (priv->matched->data, 0, priv->matched->len);
+
+		for (i = 0; i < N_FIELDS; i++)
+			trie_lookup (&priv->tries[i][family], key, plen, priv->matched->data);
+
+		for (i = 0; i < priv->linear->len; i++) {
+			const LinearMatch *match = &g_array_index (priv->linear, LinearMatch, i);
+			if (linear_match (match, family, key, plen))
+				priv->matched->data[match->entry] = TRUE;
+		}
+	}
+
+	n = candidates ? candidates->len : priv->rules->len;
+	for (i = 0; i < n; i++) {
+		guint32 entry = candidates ? g_array_index (candidates, guint32, i) : i;
+
+		if (chain != NO_ID && g_array_index (priv->chain_ids, guint32, entry) != chain)
+			continue;
+		if (target != NO_ID && g_array_index (priv->target_ids, guint32, entry) != target)
+			continue;
+		if (family >= 0 && !priv->matched->data[entry])
+			continue;
+
+		g_array_append_val (rows, entry);
+	}
+
+out:
+	return rows;
+}
+
+static void
+refilter (FirewallRuleModel *model)
+{
+	set_rows (model, filter_rows (model));
+}
+
+static void
+swap_rules (FirewallRuleModelPrivate *priv, GArray **rules, FirewallRuleset **ruleset)
+{
+	GArray *tmp_rules = priv->rules;
+	FirewallRuleset *tmp_ruleset = priv->ruleset;
+
+	priv->rules = *rules;
+	priv->ruleset = *ruleset;
+	*rules = tmp_rules;
+	*ruleset = tmp_ruleset;
+}
+
+static GtkTreeModelFlags
+firewall_rule_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+firewall_rule_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return FIREWALL_RULE_MODEL_N_COLUMNS;
+}
+
+static GType
+firewall_rule_model_get_column_type (GtkTreeModel *tree_model, gint index)
+{
+	return G_TYPE_STRING;
+}
+
+static gboolean
+firewall_rule_model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (tree_model);
+	gint *indices = gtk_tree_path_get_indices (path);
+
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	if (indices[0] < 0 || (guint)indices[0] >= N_ROWS (model->priv))
+		return FALSE;
+
+	set_iter (model, iter, indices[0]);
+
+	return TRUE;
+}
+
+static GtkTreePath *
+firewall_rule_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	g_return_val_if_fail (iter->stamp == FIREWALL_RULE_MODEL (tree_model)->priv->stamp, NULL);
+
+	return gtk_tree_path_new_from_indices (GPOINTER_TO_UINT (iter->user_data), -1);
+}
+
+static gchar *
+slice_display (const FirewallSlice *slice, gboolean negated, const gchar *absent)
+{
+	gchar *text;
+
+	if (!slice->str)
+		return g_strdup (absent);
+
+	text = firewall_slice_dup (slice);
+	if (negated) {
+		gchar *tmp = g_strconcat ("!", text, NULL);
+		g_free (text);
+		text = tmp;
+	}
+
+	return text;
+}
+
+static void
+firewall_rule_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	const FirewallRule *rule;
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (tree_model);
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	g_return_if_fail (iter->stamp == priv->stamp);
+
+	rule = ENTRY_RULE (priv, ROW_ENTRY (priv, GPOINTER_TO_UINT (iter->user_data)));
+
+	g_value_init (value, G_TYPE_STRING);
+
+	switch (column) {
+		case FIREWALL_RULE_MODEL_COLUMN_TARGET:
+			if (firewall_slice_equal (&rule->target, "ACCEPT"))
+				g_value_set_static_string (value, _("ACCEPT"));
+			else if (firewall_slice_equal (&rule->target, "DROP"))
+				g_value_set_static_string (value, _("DROP"));
+			else if (firewall_slice_equal (&rule->target, "REJECT"))
+				g_value_set_static_string (value, _("REJECT"));
+			else
+				g_value_take_string (value, firewall_slice_dup (&rule->target));
+		break;
+
+		case FIREWALL_RULE_MODEL_COLUMN_CHAIN:
+			if (firewall_slice_equal (&rule->chain, "INPUT"))
+				g_value_set_static_string (value, _("INPUT"));
+			else if (firewall_slice_equal (&rule->chain, "OUTPUT"))
+				g_value_set_static_string (value, _("OUTPUT"));
+			else if (firewall_slice_equal (&rule->chain, "FORWARD"))
+				g_value_set_static_string (value, _("FORWARD"));
+			else
+				g_value_take_string (value, firewall_slice_dup (&rule->chain));
+		break;
+
+		case FIREWALL_RULE_MODEL_COLUMN_SOURCE:
+			g_value_take_string (value, slice_display (&rule->source,
+                                 rule->flags & FIREWALL_RULE_NOT_SOURCE, "anywhere"));
+		break;
+
+		case FIREWALL_RULE_MODEL_COLUMN_DESTINATION:
+			g_value_take_string (value, slice_display (&rule->destination,
+                                 rule->flags & FIREWALL_RULE_NOT_DESTINATION, "anywhere"));
+		break;
+
+		case FIREWALL_RULE_MODEL_COLUMN_PROTOCOL:
+			g_value_take_string (value, slice_display (&rule->protocol,
+                                 rule->flags & FIREWALL_RULE_NOT_PROTOCOL, "all"));
+		break;
+
+		default:
+		break;
+	}
+}
+
+static gboolean
+firewall_rule_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (tree_model);
+	guint pos = GPOINTER_TO_UINT (iter->user_data) + 1;
+
+	if (pos >= N_ROWS (model->priv))
+		return FALSE;
+
+	set_iter (model, iter, pos);
+
+	return TRUE;
+}
+
+static gboolean
+firewall_rule_model_iter_previous (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (tree_model);
+	guint pos = GPOINTER_TO_UINT (iter->user_data);
+
+	if (pos == 0)
+		return FALSE;
+
+	set_iter (model, iter, pos - 1);
+
+	return TRUE;
+}
+
+static gboolean
+firewall_rule_model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (tree_model);
+
+	if (parent || n < 0 || (guint)n >= N_ROWS (model->priv))
+		return FALSE;
+
+	set_iter (model, iter, n);
+
+	return TRUE;
+}
+
+static gboolean
+firewall_rule_model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return firewall_rule_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+firewall_rule_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+firewall_rule_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	if (iter)
+		return 0;
+
+	return N_ROWS (FIREWALL_RULE_MODEL (tree_model)->priv);
+}
+
+static gboolean
+firewall_rule_model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void
+firewall_rule_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags       = firewall_rule_model_get_flags;
+	iface->get_n_columns   = firewall_rule_model_get_n_columns;
+	iface->get_column_type = firewall_rule_model_get_column_type;
+	iface->get_iter        = firewall_rule_model_get_iter;
+	iface->get_path        = firewall_rule_model_get_path;
+	iface->get_value       = firewall_rule_model_get_value;
+	iface->iter_next       = firewall_rule_model_iter_next;
+	iface->iter_previous   = firewall_rule_model_iter_previous;
+	iface->iter_children   = firewall_rule_model_iter_children;
+	iface->iter_has_child  = firewall_rule_model_iter_has_child;
+	iface->iter_n_children = firewall_rule_model_iter_n_children;
+	iface->iter_nth_child  = firewall_rule_model_iter_nth_child;
+	iface->iter_parent     = firewall_rule_model_iter_parent;
+}
+
+static void
+postings_free (gpointer data)
+{
+	g_array_free (data, TRUE);
+}
+
+static void
+firewall_rule_model_finalize (GObject *object)
+{
+	guint f, a;
+	FirewallRuleModel *model = FIREWALL_RULE_MODEL (object);
+	FirewallRuleModelPrivate *priv = model->priv;
+
+	g_clear_pointer (&priv->ruleset, firewall_ruleset_free);
+
+	g_array_free (priv->rules, TRUE);
+	g_array_free (priv->chain_ids, TRUE);
+	g_array_free (priv->target_ids, TRUE);
+	g_hash_table_destroy (priv->chain_lookup);
+	g_hash_table_destroy (priv->target_lookup);
+	g_ptr_array_free (priv->chains, TRUE);
+	g_ptr_array_free (priv->targets, TRUE);
+	g_ptr_array_free (priv->chain_postings, TRUE);
+	g_ptr_array_free (priv->target_postings, TRUE);
+	g_array_free (priv->linear, TRUE);
+	g_array_free (priv->rows, TRUE);
+	g_byte_array_free (priv->matched, TRUE);
+
+	for (f = 0; f < N_FIELDS; f++) {
+		for (a = 0; a < N_FAMILIES; a++)
+			trie_clear (&priv->tries[f][a]);
+	}
+
+	g_free (priv->filter_chain);
+	g_free (priv->filter_target);
+	g_free (priv->filter_address);
+
+	G_OBJECT_CLASS (firewall_rule_model_parent_class)->finalize (object);
+}
+
+static void
+firewall_rule_model_init (FirewallRuleModel *self)
+{
+	guint f, a;
+	FirewallRuleModelPrivate *priv;
+
+	priv = self->priv = firewall_rule_model_get_instance_private (self);
+
+	priv->stamp = g_random_int ();
+	priv->ruleset = NULL;
+
+	priv->rules = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->chain_ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->target_ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	/* the names are owned by the arrays */
+	priv->chains = g_ptr_array_new_with_free_func (g_free);
+	priv->targets = g_ptr_array_new_with_free_func (g_free);
+	priv->chain_lookup = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->target_lookup = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->chain_postings = g_ptr_array_new_with_free_func (postings_free);
+	priv->target_postings = g_ptr_array_new_with_free_func (postings_free);
+
+	for (f = 0; f < N_FIELDS; f++) {
+		for (a = 0; a < N_FAMILIES; a++)
+			trie_init (&priv->tries[f][a]);
+	}
+
+	priv->linear = g_array_new (FALSE, FALSE, sizeof (LinearMatch));
+	priv->rows = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->gap_start = 0;
+	priv->gap_len = 0;
+	priv->matched = g_byte_array_new ();
+
+	priv->filter_chain = NULL;
+	priv->filter_target = NULL;
+	priv->filter_address = NULL;
+}
+
+static void
+firewall_rule_model_class_init (FirewallRuleModelClass *class)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+	object_class->finalize = firewall_rule_model_finalize;
+}
+
+FirewallRuleModel *
+firewall_rule_model_new (void)
+{
+	return g_object_new (FIREWALL_TYPE_RULE_MODEL, NULL);
+}
+
+/* Shows the filter table of @ruleset, which the model takes over.  The
+ * current filter stays in effect.  Rows are matched by rule, so only the
+ * rules that came or went are deleted or inserted and the view keeps its
+ * selection and scroll position. */
+void
+firewall_rule_model_set_ruleset (FirewallRuleModel *model, FirewallRuleset *ruleset)
+{
+	guint i, j, k, n_kept = 0;
+	GArray *rows, *old_rules, *match;
+	GPtrArray *shown, *wanted;
+	FirewallRuleset *old_ruleset;
+	FirewallRuleModelPrivate *priv;
+
+	g_return_if_fail (FIREWALL_IS_RULE_MODEL (model));
+
+	priv = model->priv;
+
+	shown = g_ptr_array_sized_new (priv->rows->len);
+	for (i = 0; i < priv->rows->len; i++)
+		g_ptr_array_add (shown, (gpointer)ENTRY_RULE (priv, ROW_ENTRY (priv, i)));
+
+	/* the new index is built beside the old rules, which the rows show
+	 * until they are deleted */
+	old_ruleset = priv->ruleset;
+	old_rules = priv->rules;
+	priv->ruleset = ruleset;
+	priv->rules = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	index_clear (priv);
+	index_build (priv);
+
+	rows = filter_rows (model);
+
+	wanted = g_ptr_array_sized_new (rows->len);
+	for (j = 0; j < rows->len; j++)
+		g_ptr_array_add (wanted, (gpointer)ENTRY_RULE (priv, g_array_index (rows, guint32, j)));
+
+	match = rows_match (shown, wanted);
+
+	swap_rules (priv, &old_rules, &old_ruleset);
+
+	rows_edit_begin (priv, 0);
+	for (i = 0; i < match->len; i++) {
+		if (g_array_index (match, guint32, i) == NO_ENTRY) {
+			rows_edit_delete (model);
+		} else {
+			rows_edit_keep (priv, rows_edit_next (priv));
+			n_kept++;
+		}
+	}
+	rows_edit_end (priv);
+
+	swap_rules (priv, &old_rules, &old_ruleset);
+
+	/* the rows left show the same rules under their new entries */
+	for (i = 0, k = 0; i < match->len; i++) {
+		guint32 pos = g_array_index (match, guint32, i);
+		if (pos != NO_ENTRY)
+			g_array_index (priv->rows, guint32, k++) = g_array_index (rows, guint32, pos);
+	}
+	priv->stamp++;
+
+	rows_edit_begin (priv, rows->len - n_kept);
+	for (i = 0, j = 0; j < rows->len; j++) {
+		while (i < match->len && g_array_index (match, guint32, i) == NO_ENTRY)
+			i++;
+
+		if (i < match->len && g_array_index (match, guint32, i) == j) {
+			rows_edit_keep (priv, g_array_index (rows, guint32, j));
+			i++;
+		} else {
+			rows_edit_insert (model, g_array_index (rows, guint32, j));
+		}
+	}
+	rows_edit_end (priv);
+
+	g_ptr_array_free (shown, TRUE);
+	g_ptr_array_free (wanted, TRUE);
+	g_array_free (match, TRUE);
+	g_array_free (rows, TRUE);
+	g_array_free (old_rules, TRUE);
+	if (old_ruleset)
+		firewall_ruleset_free (old_ruleset);
+}
+
+/* Number of filter table rules, whatever the filter. */
+guint
+firewall_rule_model_get_n_rules (FirewallRuleModel *model)
+{
+	g_return_val_if_fail (FIREWALL_IS_RULE_MODEL (model), 0);
+
+	return model->priv->rules->len;
+}
+
+static gchar **
+names_dup (GPtrArray *names)
+{
+	guint i;
+	gchar **strv = g_new0 (gchar *, names->len + 1);
+
+	for (i = 0; i < names->len; i++)
+		strv[i] = g_strdup (g_ptr_array_index (names, i));
+
+	return strv;
+}
+
+/* Chain names in order of appearance. */
+gchar **
+firewall_rule_model_list_chains (FirewallRuleModel *model)
+{
+	g_return_val_if_fail (FIREWALL_IS_RULE_MODEL (model), NULL);
+
+	return names_dup (model->priv->chains);
+}
+
+/* Target names in order of appearance. */
+gchar **
+firewall_rule_model_list_targets (FirewallRuleModel *model)
+{
+	g_return_val_if_fail (FIREWALL_IS_RULE_MODEL (model), NULL);
+
+	return names_dup (model->priv->targets);
+}
+
+/* Only shows the rules of @chain jumping to @target whose source or
+ * destination contains @address, or lies inside it when @address is a
+ * network.  NULL or empty arguments do not filter.  Returns FALSE if
+ * @address could not be parsed; no rule is shown then. */
+gboolean
+firewall_rule_model_set_filter (FirewallRuleModel *model,
+                                const gchar       *chain,
+                                const gchar       *target,
+                                const gchar       *address)
+{
+	guint8 key[16], mask[16];
+	gint plen;
+	gboolean valid = TRUE;
+	FirewallRuleModelPrivate *priv;
+
+	g_return_val_if_fail (FIREWALL_IS_RULE_MODEL (model), FALSE);
+
+	priv = model->priv;
+
+	g_free (priv->filter_chain);
+	g_free (priv->filter_target);
+	g_free (priv->filter_address);
+
+	priv->filter_chain = (chain && *chain) ? g_strdup (chain) : NULL;
+	priv->filter_target = (target && *target) ? g_strdup (target) : NULL;
+	priv->filter_address = (address && *address) ? g_strstrip (g_strdup (address)) : NULL;
+
+	if (priv->filter_address) {
+		valid = (address_parse (priv->filter_address, strlen (priv->filter_address),
+                                key, mask, &plen) >= 0 && plen >= 0);
+	}
+
+	refilter (model);
+
+	return valid;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _FIREWALL_RULE_MODEL_H_
+#define _FIREWALL_RULE_MODEL_H_
+
+#include <gtk/gtk.h>
+
+#include "firewall-ruleset.h"
+
+G_BEGIN_DECLS
+
+#define FIREWALL_TYPE_RULE_MODEL            (firewall_rule_model_get_type ())
+#define FIREWALL_RULE_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FIREWALL_TYPE_RULE_MODEL, FirewallRuleModel))
+#define FIREWALL_RULE_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FIREWALL_TYPE_RULE_MODEL, FirewallRuleModelClass))
+#define FIREWALL_IS_RULE_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FIREWALL_TYPE_RULE_MODEL))
+#define FIREWALL_IS_RULE_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FIREWALL_TYPE_RULE_MODEL))
+#define FIREWALL_RULE_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FIREWALL_TYPE_RULE_MODEL, FirewallRuleModelClass))
+
+typedef struct _FirewallRuleModel        FirewallRuleModel;
+typedef struct _FirewallRuleModelClass   FirewallRuleModelClass;
+typedef struct _FirewallRuleModelPrivate FirewallRuleModelPrivate;
+
+
+struct _FirewallRuleModel {
+	GObject __parent__;
+
+	FirewallRuleModelPrivate *priv;
+};
+
+struct _FirewallRuleModelClass {
+	GObjectClass __parent_class__;
+};
+
+enum {
+	FIREWALL_RULE_MODEL_COLUMN_TARGET,
+	FIREWALL_RULE_MODEL_COLUMN_CHAIN,
+	FIREWALL_RULE_MODEL_COLUMN_SOURCE,
+	FIREWALL_RULE_MODEL_COLUMN_DESTINATION,
+	FIREWALL_RULE_MODEL_COLUMN_PROTOCOL,
+	FIREWALL_RULE_MODEL_N_COLUMNS
+};
+
+
+GType              firewall_rule_model_get_type     (void) G_GNUC_CONST;
+
+FirewallRuleModel *firewall_rule_model_new          (void);
+
+void               firewall_rule_model_set_ruleset  (FirewallRuleModel *model,
+                                                     FirewallRuleset   *ruleset);
+
+guint              firewall_rule_model_get_n_rules  (FirewallRuleModel *model);
+
+gchar            **firewall_rule_model_list_chains  (FirewallRuleModel *model);
+gchar            **firewall_rule_model_list_targets (FirewallRuleModel *model);
+
+gboolean           firewall_rule_model_set_filter   (FirewallRuleModel *model,
+                                                     const gchar       *chain,
+                                                     const gchar       *target,
+                                                     const gchar       *address);
+
+G_END_DECLS
+
+#endif /* _FIREWALL_RULE_MODEL_H_ */
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "firewall-ruleset.h"
+
+#include <string.h>
+
+
+/*
+ * Parses the output of "iptables-save -c" in one pass:
+ *
+ *   *filter
+ *   :INPUT DROP [12:3456]
+ *   [3:180] -A INPUT -s 10.0.0.0/8 -i eth0 -p tcp -m tcp --dport 22 -j ACCEPT
+ *   COMMIT
+ *
+ * Rules and chains only point into the dump, which the ruleset keeps a
+ * reference on.  Quoted arguments (e.g. comments) keep their escapes.
+ */
+struct _FirewallRuleset {
+	GBytes *dump;
+	GArray *rules;
+	GArray *chains;
+};
+
+typedef struct {
+	const gchar *p;
+	const gchar *end;
+} Tokenizer;
+
+
+static gboolean
+tokenizer_next (Tokenizer *tok, FirewallSlice *token)
+{
+	const gchar *p = tok->p;
+
+	while (p < tok->end && (*p == ' ' || *p == '\t'))
+		p++;
+
+	if (p >= tok->end) {
+		tok->p = p;
+		return FALSE;
+	}
+
+	if (*p == '"') {
+		const gchar *start = ++p;
+
+		while (p < tok->end && *p != '"') {
+			if (*p == '\\' && p + 1 < tok->end)
+				p++;
+			p++;
+		}
+
+		token->str = start;
+		token->len = p - start;
+		tok->p = (p < tok->end) ? p + 1 : p;
+		return TRUE;
+	}
+
+	token->str = p;
+	while (p < tok->end && *p != ' ' && *p != '\t')
+		p++;
+	token->len = p - token->str;
+	tok->p = p;
+
+	return TRUE;
+}
+
+static gboolean
+slice_is (const FirewallSlice *slice, const gchar *str, gsize len)
+{
+	return (slice->len == len && memcmp (slice->str, str, len) == 0);
+}
+
+#define SLICE_IS(slice, literal) slice_is ((slice), literal, sizeof (literal) - 1)
+
+static guint64
+parse_u64 (const gchar **p, const gchar *end)
+{
+	guint64 value = 0;
+
+	while (*p < end && g_ascii_isdigit (**p)) {
+		value = value * 10 + (**p - '0');
+		(*p)++;
+	}
+
+	return value;
+}
+
+/* "[packets:bytes]" */
+static gboolean
+parse_counters (const FirewallSlice *token, guint64 *packets, guint64 *bytes)
+{
+	const gchar *p = token->str;
+	const gchar *end = token->str + token->len;
+
+	if (token->len < 5 || *p != '[' || end[-1] != ']')
+		return FALSE;
+
+	p++;
+	*packets = parse_u64 (&p, end);
+	if (p >= end || *p != ':')
+		return FALSE;
+
+	p++;
+	*bytes = parse_u64 (&p, end);
+
+	return TRUE;
+}
+
+static void
+parse_chain (FirewallRuleset *ruleset, const FirewallSlice *table, Tokenizer *tok)
+{
+	FirewallChain chain = { 0, };
+	FirewallSlice token;
+
+	chain.table = *table;
+
+	if (!tokenizer_next (tok, &chain.name))
+		return;
+
+	/* ":" is part of the first token */
+	chain.name.str++;
+	chain.name.len--;
+
+	if (tokenizer_next (tok, &chain.policy) && tokenizer_next (tok, &token))
+		parse_counters (&token, &chain.packets, &chain.bytes);
+
+	g_array_append_val (ruleset->chains, chain);
+}
+
+static void
+parse_rule (FirewallRuleset *ruleset, const FirewallSlice *table, Tokenizer *tok)
+{
+	FirewallRule rule = { 0, };
+	FirewallSlice token, value;
+	FirewallRuleFlags negate = 0;
+	const gchar *matches_end = NULL;
+
+	rule.table = *table;
+
+	while (tokenizer_next (tok, &token)) {
+		FirewallSlice *field = NULL;
+		FirewallRuleFlags flag = 0;
+
+		if (!rule.chain.str && token.str[0] == '[') {
+			parse_counters (&token, &rule.packets, &rule.bytes);
+			continue;
+		}
+
+		if (SLICE_IS (&token, "!")) {
+			negate = ~0;
+			continue;
+		}
+
+		if (SLICE_IS (&token, "-A")) {
+			field = &rule.chain;
+		} else if (SLICE_IS (&token, "-s")) {
+			field = &rule.source;
+			flag = FIREWALL_RULE_NOT_SOURCE;
+		} else if (SLICE_IS (&token, "-d")) {
+			field = &rule.destination;
+			flag = FIREWALL_RULE_NOT_DESTINATION;
+		} else if (SLICE_IS (&token, "-p")) {
+			field = &rule.protocol;
+			flag = FIREWALL_RULE_NOT_PROTOCOL;
+		} else if (SLICE_IS (&token, "-i")) {
+			field = &rule.in_iface;
+			flag = FIREWALL_RULE_NOT_IN_IFACE;
+		} else if (SLICE_IS (&token, "-o")) {
+			field = &rule.out_iface;
+			flag = FIREWALL_RULE_NOT_OUT_IFACE;
+		} else if (SLICE_IS (&token, "--sport") || SLICE_IS (&token, "--sports")) {
+			field = &rule.sports;
+			flag = FIREWALL_RULE_NOT_SPORTS;
+		} else if (SLICE_IS (&token, "--dport") || SLICE_IS (&token, "--dports")) {
+			field = &rule.dports;
+			flag = FIREWALL_RULE_NOT_DPORTS;
+		} else if (SLICE_IS (&token, "-j") || SLICE_IS (&token, "-g")) {
+			if (tokenizer_next (tok, &rule.target)) {
+				/* the rest of the line belongs to the target */
+				const gchar *p = tok->p;
+				while (p < tok->end && (*p == ' ' || *p == '\t'))
+					p++;
+				rule.target_options.str = p;
+				rule.target_options.len = tok->end - p;
+			}
+			break;
+		} else if (SLICE_IS (&token, "-m")) {
+			if (!rule.matches.str)
+				rule.matches.str = token.str;
+		}
+
+		if (field) {
+			if (!tokenizer_next (tok, &value))
+				break;
+
+			/* the first occurrence wins, later ones belong to other modules */
+			if (!field->str) {
+				*field = value;
+				rule.flags |= (negate & flag);
+			}
+		}
+
+		negate = 0;
+
+		if (rule.matches.str)
+			matches_end = tok->p;
+	}
+
+	if (rule.matches.str)
+		rule.matches.len = matches_end - rule.matches.str;
+
+	if (rule.chain.str)
+		g_array_append_val (ruleset->rules, rule);
+}
+
+/* A NULL @dump gives an empty ruleset. */
+FirewallRuleset *
+firewall_ruleset_parse (GBytes *dump)
+{
+	FirewallRuleset *ruleset;
+	FirewallSlice table = { NULL, 0 };
+	const gchar *p = NULL, *end = NULL;
+	gsize size;
+
+	ruleset = g_new0 (FirewallRuleset, 1);
+	ruleset->rules = g_array_new (FALSE, FALSE, sizeof (FirewallRule));
+	ruleset->chains = g_array_new (FALSE, FALSE, sizeof (FirewallChain));
+
+	if (dump) {
+		ruleset->dump = g_bytes_ref (dump);
+		p = g_bytes_get_data (dump, &size);
+		end = p ? p + size : NULL;
+	}
+
+	while (p && p < end) {
+		Tokenizer tok;
+		const gchar *eol = memchr (p, '\n', end - p);
+
+		if (!eol)
+			eol = end;
+
+		tok.p = p;
+		tok.end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+		switch (*p) {
+			case '*':
+				table.str = p + 1;
+				table.len = tok.end - table.str;
+				break;
+
+			case ':':
+				parse_chain (ruleset, &table, &tok);
+				break;
+
+			case '[':
+			case '-':
+				parse_rule (ruleset, &table, &tok);
+				break;
+
+			default:
+				/* comments, COMMIT and blank lines */
+				break;
+		}
+
+		p = (eol < end) ? eol + 1 : end;
+	}
+
+	return ruleset;
+}
+
+void
+firewall_ruleset_free (FirewallRuleset *ruleset)
+{
+	if (!ruleset)
+		return;
+
+	g_array_free (ruleset->rules, TRUE);
+	g_array_free (ruleset->chains, TRUE);
+	if (ruleset->dump)
+		g_bytes_unref (ruleset->dump);
+	g_free (ruleset);
+}
+
+guint
+firewall_ruleset_get_n_rules (FirewallRuleset *ruleset)
+{
+	return ruleset->rules->len;
+}
+
+const FirewallRule *
+firewall_ruleset_get_rule (FirewallRuleset *ruleset, guint index)
+{
+	g_return_val_if_fail (index < ruleset->rules->len, NULL);
+
+	return &g_array_index (ruleset->rules, FirewallRule, index);
+}
+
+guint
+firewall_ruleset_get_n_chains (FirewallRuleset *ruleset)
+{
+	return ruleset->chains->len;
+}
+
+const FirewallChain *
+firewall_ruleset_get_chain (FirewallRuleset *ruleset, guint index)
+{
+	g_return_val_if_fail (index < ruleset->chains->len, NULL);
+
+	return &g_array_index (ruleset->chains, FirewallChain, index);
+}
+
+const FirewallChain *
+firewall_ruleset_find_chain (FirewallRuleset *ruleset,
+                             const gchar     *table,
+                             const gchar     *name)
+{
+	guint i;
+
+	for (i = 0; i < ruleset->chains->len; i++) {
+		const FirewallChain *chain = &g_array_index (ruleset->chains, FirewallChain, i);
+
+		if (firewall_slice_equal (&chain->table, table) &&
+            firewall_slice_equal (&chain->name, name))
+			return chain;
+	}
+
+	return NULL;
+}
+
+static gboolean
+slices_equal (const FirewallSlice *a, const FirewallSlice *b)
+{
+	return slice_is (a, b->str, b->len);
+}
+
+/* Whether @a and @b are the same rule, whatever their counters. */
+gboolean
+firewall_rule_equal (const FirewallRule *a, const FirewallRule *b)
+{
+	return (a->flags == b->flags &&
+            slices_equal (&a->table, &b->table) &&
+            slices_equal (&a->chain, &b->chain) &&
+            slices_equal (&a->target, &b->target) &&
+            slices_equal (&a->target_options, &b->target_options) &&
+            slices_equal (&a->protocol, &b->protocol) &&
+            slices_equal (&a->source, &b->source) &&
+            slices_equal (&a->destination, &b->destination) &&
+            slices_equal (&a->in_iface, &b->in_iface) &&
+            slices_equal (&a->out_iface, &b->out_iface) &&
+            slices_equal (&a->sports, &b->sports) &&
+            slices_equal (&a->dports, &b->dports) &&
+            slices_equal (&a->matches, &b->matches));
+}
+
+static guint
+slice_hash (guint hash, const FirewallSlice *slice)
+{
+	gsize i;
+
+	for (i = 0; i < slice->len; i++)
+		hash = hash * 33 + (guchar)slice->str[i];
+
+	return hash * 33 + slice->len;
+}
+
+/* A hash of what firewall_rule_equal() compares. */
+guint
+firewall_rule_hash (const FirewallRule *rule)
+{
+	guint hash = rule->flags;
+
+	hash = slice_hash (hash, &rule->table);
+	hash = slice_hash (hash, &rule->chain);
+	hash = slice_hash (hash, &rule->target);
+	hash = slice_hash (hash, &rule->target_options);
+	hash = slice_hash (hash, &rule->protocol);
+	hash = slice_hash (hash, &rule->source);
+	hash = slice_hash (hash, &rule->destination);
+	hash = slice_hash (hash, &rule->in_iface);
+	hash = slice_hash (hash, &rule->out_iface);
+	hash = slice_hash (hash, &rule->sports);
+	hash = slice_hash (hash, &rule->dports);
+
+	return slice_hash (hash, &rule->matches);
+}
+
+gboolean
+firewall_slice_equal (const FirewallSlice *slice, const gchar *str)
+{
+	return slice_is (slice, str, strlen (str));
+}
+
+gchar *
+firewall_slice_dup (const FirewallSlice *slice)
+{
+	return g_strndup (slice->str, slice->len);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _FIREWALL_RULESET_H_
+#define _FIREWALL_RULESET_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A field of the dump, not NUL-terminated; empty when absent. */
+typedef struct {
+	const gchar *str;
+	gsize        len;
+} FirewallSlice;
+
+typedef enum {
+	FIREWALL_RULE_NOT_SOURCE      = 1 << 0,
+	FIREWALL_RULE_NOT_DESTINATION = 1 << 1,
+	FIREWALL_RULE_NOT_PROTOCOL    = 1 << 2,
+	FIREWALL_RULE_NOT_IN_IFACE    = 1 << 3,
+	FIREWALL_RULE_NOT_OUT_IFACE   = 1 << 4,
+	FIREWALL_RULE_NOT_SPORTS      = 1 << 5,
+	FIREWALL_RULE_NOT_DPORTS      = 1 << 6
+} FirewallRuleFlags;
+
+typedef struct {
+	FirewallSlice table;
+	FirewallSlice name;
+	FirewallSlice policy;   /* "-" for user defined chains */
+	guint64       packets;
+	guint64       bytes;
+} FirewallChain;
+
+typedef struct {
+	FirewallSlice     table;
+	FirewallSlice     chain;
+	FirewallSlice     target;
+	FirewallSlice     target_options;
+	FirewallSlice     protocol;
+	FirewallSlice     source;
+	FirewallSlice     destination;
+	FirewallSlice     in_iface;
+	FirewallSlice     out_iface;
+	FirewallSlice     sports;
+	FirewallSlice     dports;
+	FirewallSlice     matches;  /* "-m <module> <options>..." verbatim */
+	FirewallRuleFlags flags;
+	guint64           packets;
+	guint64           bytes;
+} FirewallRule;
+
+typedef struct _FirewallRuleset FirewallRuleset;
+
+
+FirewallRuleset     *firewall_ruleset_parse        (GBytes                *dump);
+void                 firewall_ruleset_free         (FirewallRuleset       *ruleset);
+
+guint                firewall_ruleset_get_n_rules  (FirewallRuleset       *ruleset);
+const FirewallRule  *firewall_ruleset_get_rule     (FirewallRuleset       *ruleset,
+                                                    guint                  index);
+
+guint                firewall_ruleset_get_n_chains (FirewallRuleset       *ruleset);
+const FirewallChain *firewall_ruleset_get_chain    (FirewallRuleset       *ruleset,
+                                                    guint                  index);
+const FirewallChain *firewall_ruleset_find_chain   (FirewallRuleset       *ruleset,
+                                                    const gchar           *table,
+                                                    const gchar           *name);
+
+gboolean             firewall_rule_equal           (const FirewallRule    *a,
+                                                    const FirewallRule    *b);
+guint                firewall_rule_hash            (const FirewallRule    *rule);
+
+gboolean             firewall_slice_equal          (const FirewallSlice   *slice,
+                                                    const gchar           *str);
+gchar               *firewall_slice_dup            (const FirewallSlice   *slice);
+
+G_END_DECLS
+
+#endif /* _FIREWALL_RULESET_H_ */
@@ -0,0 +1,571 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "common.h"
+#include "security-log-index.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+
+#define INDEX_MAGIC       0x58444c47 /* "GLDX" */
+#define INDEX_VERSION     1
+#define SECONDS_PER_DAY   86400
+
+/*
+ * The index keeps what the log parser reported for [covered_from,
+ * covered_to) in three files under $XDG_CACHE_HOME/gooroom-security-status:
+ *
+ *   log-entries  IndexHeader, then one IndexRecord per entry, oldest first
+ *   log-days     one IndexDay per UTC day, the first record of that day
+ *   log-strings  the NUL-terminated log lines the records point into
+ *
+ * Files only grow at their end and the header, written last, tells how
+ * much of each is valid, so an interrupted append is simply ignored.
+ * Entries older than the indexed range cannot be appended; that case
+ * writes the whole index anew.  Lookups binary search the mapped files.
+ */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 n_records;
+	guint32 n_days;
+	guint32 text_size;
+	guint32 reserved;
+	gint64  covered_from;
+	gint64  covered_to;
+} IndexHeader;
+
+typedef struct {
+	gint64  utime;
+	guint32 text_offset;
+	guint8  level;
+	guint8  category;
+	guint8  reserved[2];
+} IndexRecord;
+
+typedef struct {
+	gint64  day;
+	guint32 first_record;
+	guint32 reserved;
+} IndexDay;
+
+struct _SecurityLogIndex {
+	gchar       *entries_path;
+	gchar       *days_path;
+	gchar       *strings_path;
+
+	/* NULL while there is no valid index */
+	GMappedFile *entries;
+	GMappedFile *days;
+	GMappedFile *strings;
+
+	IndexHeader  header;
+};
+
+/* records, days and text being added, numbered as they will be on disk */
+typedef struct {
+	GArray      *records;
+	GArray      *days;
+	GString     *text;
+	guint32      first_record;
+	guint32      text_base;
+	gint64       last_day;
+} IndexBuilder;
+
+typedef struct {
+	gint64       utime;
+	guint        entry;
+} NewEntry;
+
+
+#define INDEX_RECORDS(index) ((const IndexRecord *)(g_mapped_file_get_contents ((index)->entries) + sizeof (IndexHeader)))
+#define INDEX_DAYS(index)    ((const IndexDay *)g_mapped_file_get_contents ((index)->days))
+#define INDEX_TEXT(index)    ((const gchar *)g_mapped_file_get_contents ((index)->strings))
+
+
+static gint64
+utime_day (gint64 utime)
+{
+	if (utime >= 0)
+		return utime / SECONDS_PER_DAY;
+
+	return -((-utime + SECONDS_PER_DAY - 1) / SECONDS_PER_DAY);
+}
+
+static void
+index_unmap (SecurityLogIndex *index)
+{
+	g_clear_pointer (&index->entries, g_mapped_file_unref);
+	g_clear_pointer (&index->days, g_mapped_file_unref);
+	g_clear_pointer (&index->strings, g_mapped_file_unref);
+
+	memset (&index->header, 0, sizeof (IndexHeader));
+}
+
+static gboolean
+index_map (SecurityLogIndex *index)
+{
+	const IndexHeader *header;
+
+	index_unmap (index);
+
+	index->entries = g_mapped_file_new (index->entries_path, FALSE, NULL);
+	index->days = g_mapped_file_new (index->days_path, FALSE, NULL);
+	index->strings = g_mapped_file_new (index->strings_path, FALSE, NULL);
+
+	if (!index->entries || !index->days || !index->strings)
+		goto invalid;
+
+	if (g_mapped_file_get_length (index->entries) < sizeof (IndexHeader))
+		goto invalid;
+
+	header = (const IndexHeader *)g_mapped_file_get_contents (index->entries);
+	if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION)
+		goto invalid;
+
+	if (g_mapped_file_get_length (index->entries) < sizeof (IndexHeader) + (gsize)header->n_records * sizeof (IndexRecord) ||
+        g_mapped_file_get_length (index->days) < (gsize)header->n_days * sizeof (IndexDay) ||
+        g_mapped_file_get_length (index->strings) < header->text_size)
+		goto invalid;
+
+	index->header = *header;
+
+	return TRUE;
+
+invalid:
+	index_unmap (index);
+
+	return FALSE;
+}
+
+/* First record not older than @utime: the day table narrows the search to
+ * one day's records before bisecting them. */
+static guint
+index_lower_bound (SecurityLogIndex *index, gint64 utime)
+{
+	guint lo, hi, dlo, dhi;
+	gint64 day = utime_day (utime);
+	const IndexDay *days = INDEX_DAYS (index);
+	const IndexRecord *records = INDEX_RECORDS (index);
+
+	dlo = 0;
+	dhi = index->header.n_days;
+	while (dlo < dhi) {
+		guint mid = dlo + (dhi - dlo) / 2;
+		if (days[mid].day <= day)
+			dlo = mid + 1;
+		else
+			dhi = mid;
+	}
+
+	lo = (dlo > 0) ? days[dlo - 1].first_record : 0;
+	hi = (dlo < index->header.n_days) ? days[dlo].first_record : index->header.n_records;
+	hi = MIN (hi, index->header.n_records);
+	lo = MIN (lo, hi);
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (records[mid].utime < utime)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static gboolean
+write_at (const gchar *path, goffset offset, gconstpointer buf, gsize len)
+{
+	gint fd;
+	gboolean ret;
+
+	fd = g_open (path, O_WRONLY | O_CREAT, 0600);
+	if (fd < 0)
+		return FALSE;
+
+	ret = (pwrite (fd, buf, len, offset) == (gssize)len);
+
+	if (close (fd) != 0)
+		ret = FALSE;
+
+	return ret;
+}
+
+static void
+builder_init (IndexBuilder *builder, guint32 first_record, guint32 text_base, gint64 last_day)
+{
+	builder->records = g_array_new (FALSE, FALSE, sizeof (IndexRecord));
+	builder->days = g_array_new (FALSE, FALSE, sizeof (IndexDay));
+	builder->text = g_string_new (NULL);
+	builder->first_record = first_record;
+	builder->text_base = text_base;
+	builder->last_day = last_day;
+}
+
+static void
+builder_clear (IndexBuilder *builder)
+{
+	g_array_free (builder->records, TRUE);
+	g_array_free (builder->days, TRUE);
+	g_string_free (builder->text, TRUE);
+}
+
+static gboolean
+builder_add (IndexBuilder *builder, gint64 utime, guint8 level, guint8 category, const gchar *line)
+{
+	gsize len = strlen (line) + 1;
+	gint64 day = utime_day (utime);
+	IndexRecord record = { 0, };
+
+	if ((guint64)builder->text_base + builder->text->len + len > G_MAXUINT32)
+		return FALSE;
+
+	if (day > builder->last_day) {
+		IndexDay d = { 0, };
+
+		d.day = day;
+		d.first_record = builder->first_record + builder->records->len;
+		g_array_append_val (builder->days, d);
+		builder->last_day = day;
+	}
+
+	record.utime = utime;
+	record.text_offset = builder->text_base + builder->text->len;
+	record.level = level;
+	record.category = category;
+
+	g_string_append_len (builder->text, line, len);
+	g_array_append_val (builder->records, record);
+
+	return TRUE;
+}
+
+static gboolean
+builder_add_entries (IndexBuilder *builder, SecurityLogModel *model, NewEntry *entries, guint n)
+{
+	guint i;
+
+	for (i = 0; i < n; i++) {
+		gint64 utime;
+		guint8 level, category;
+		const gchar *line;
+
+		security_log_model_get_entry (model, entries[i].entry, &utime, &level, &category, &line);
+		if (!builder_add (builder, utime, level, category, line))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gint
+compare_new_entry (gconstpointer a, gconstpointer b)
+{
+	const NewEntry *ea = a;
+	const NewEntry *eb = b;
+
+	if (ea->utime != eb->utime)
+		return (ea->utime < eb->utime) ? -1 : 1;
+
+	return (ea->entry < eb->entry) ? -1 : (ea->entry > eb->entry);
+}
+
+/* Writes @head, the current records and @tail as a new index.  The
+ * entries file goes first and comes back last, so a crash in between
+ * leaves no index rather than a mismatched one. */
+static gboolean
+index_rewrite (SecurityLogIndex *index,
+               SecurityLogModel *model,
+               NewEntry         *head,
+               guint             n_head,
+               NewEntry         *tail,
+               guint             n_tail,
+               gint64            covered_from,
+               gint64            covered_to)
+{
+	guint i;
+	gboolean ret = FALSE;
+	IndexHeader header = { 0, };
+	IndexBuilder builder;
+	GString *entries;
+
+	builder_init (&builder, 0, 0, G_MININT64);
+
+	if (!builder_add_entries (&builder, model, head, n_head))
+		goto out;
+
+	if (index->entries) {
+		const IndexRecord *records = INDEX_RECORDS (index);
+		const gchar *text = INDEX_TEXT (index);
+
+		for (i = 0; i < index->header.n_records; i++) {
+			const IndexRecord *r = &records[i];
+
+			if (r->text_offset >= index->header.text_size ||
+                !memchr (text + r->text_offset, '\0', index->header.text_size - r->text_offset))
+				continue;
+
+			if (!builder_add (&builder, r->utime, r->level, r->category, text + r->text_offset))
+				goto out;
+		}
+	}
+
+	if (!builder_add_entries (&builder, model, tail, n_tail))
+		goto out;
+
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.n_records = builder.records->len;
+	header.n_days = builder.days->len;
+	header.text_size = builder.text->len;
+	header.covered_from = covered_from;
+	header.covered_to = covered_to;
+
+	entries = g_string_sized_new (sizeof (IndexHeader) + builder.records->len * sizeof (IndexRecord));
+	g_string_append_len (entries, (const gchar *)&header, sizeof (IndexHeader));
+	g_string_append_len (entries, builder.records->data, builder.records->len * sizeof (IndexRecord));
+
+	index_unmap (index);
+	g_unlink (index->entries_path);
+
+	ret = g_file_set_contents (index->strings_path, builder.text->str, builder.text->len, NULL) &&
+          g_file_set_contents (index->days_path, builder.days->data, builder.days->len * sizeof (IndexDay), NULL) &&
+          g_file_set_contents (index->entries_path, entries->str, entries->len, NULL);
+
+	g_string_free (entries, TRUE);
+
+	index_map (index);
+
+out:
+	builder_clear (&builder);
+
+	return ret;
+}
+
+/* Adds @tail, all newer than the indexed range, at the end of the files. */
+static gboolean
+index_append (SecurityLogIndex *index,
+              SecurityLogModel *model,
+              NewEntry         *tail,
+              guint             n_tail,
+              gint64            covered_to)
+{
+	gboolean ret = FALSE;
+	IndexHeader header = index->header;
+	IndexBuilder builder;
+	gint64 last_day = G_MININT64;
+
+	if (header.n_days > 0)
+		last_day = INDEX_DAYS (index)[header.n_days - 1].day;
+
+	builder_init (&builder, header.n_records, header.text_size, last_day);
+
+	if (!builder_add_entries (&builder, model, tail, n_tail))
+		goto out;
+
+	if (!write_at (index->strings_path, header.text_size, builder.text->str, builder.text->len) ||
+        !write_at (index->days_path, (goffset)header.n_days * sizeof (IndexDay),
+                   builder.days->data, builder.days->len * sizeof (IndexDay)) ||
+        !write_at (index->entries_path, sizeof (IndexHeader) + (goffset)header.n_records * sizeof (IndexRecord),
+                   builder.records->data, builder.records->len * sizeof (IndexRecord)))
+		goto out;
+
+	header.n_records += builder.records->len;
+	header.n_days += builder.days->len;
+	header.text_size += builder.text->len;
+	header.covered_to = covered_to;
+
+	ret = write_at (index->entries_path, 0, &header, sizeof (IndexHeader));
+
+	index_map (index);
+
+out:
+	builder_clear (&builder);
+
+	return ret;
+}
+
+SecurityLogIndex *
+security_log_index_open (void)
+{
+	gchar *dir;
+	SecurityLogIndex *index;
+
+	dir = g_build_filename (g_get_user_cache_dir (), "gooroom-security-status", NULL);
+	if (g_mkdir_with_parents (dir, 0700) != 0) {
+		g_free (dir);
+		return NULL;
+	}
+
+	index = g_new0 (SecurityLogIndex, 1);
+	index->entries_path = g_build_filename (dir, "log-entries", NULL);
+	index->days_path = g_build_filename (dir, "log-days", NULL);
+	index->strings_path = g_build_filename (dir, "log-strings", NULL);
+
+	/* a missing or damaged index just starts out empty */
+	index_map (index);
+
+	g_free (dir);
+
+	return index;
+}
+
+void
+security_log_index_free (SecurityLogIndex *index)
+{
+	if (!index)
+		return;
+
+	index_unmap (index);
+
+	g_free (index->entries_path);
+	g_free (index->days_path);
+	g_free (index->strings_path);
+	g_free (index);
+}
+
+/* Gets the time range [from, to) the index holds every entry of. */
+gboolean
+security_log_index_get_range (SecurityLogIndex *index, gint64 *from_utime, gint64 *to_utime)
+{
+	g_return_val_if_fail (index != NULL, FALSE);
+
+	if (!index->entries)
+		return FALSE;
+
+	if (from_utime)
+		*from_utime = index->header.covered_from;
+	if (to_utime)
+		*to_utime = index->header.covered_to;
+
+	return TRUE;
+}
+
+/* Appends the indexed entries of [from, to) to @model, oldest first, and
+ * returns how many there were.  The model still has to be flushed. */
+guint
+security_log_index_load (SecurityLogIndex *index,
+                         SecurityLogModel *model,
+                         gint64            from_utime,
+                         gint64            to_utime)
+{
+	guint i, count = 0;
+	const IndexRecord *records;
+	const gchar *text;
+
+	g_return_val_if_fail (index != NULL, 0);
+
+	if (!index->entries || index->header.n_records == 0)
+		return 0;
+
+	records = INDEX_RECORDS (index);
+	text = INDEX_TEXT (index);
+
+	for (i = index_lower_bound (index, from_utime); i < index->header.n_records; i++) {
+		const IndexRecord *r = &records[i];
+
+		if (r->utime >= to_utime)
+			break;
+
+		if (r->level >= SECURITY_LOG_N_LEVELS ||
+            r->text_offset >= index->header.text_size ||
+            !memchr (text + r->text_offset, '\0', index->header.text_size - r->text_offset))
+			continue;
+
+		security_log_model_append (model, r->utime, r->level, r->category, text + r->text_offset);
+		count++;
+	}
+
+	return count;
+}
+
+/* Records the entries a finished parser run added to @model from
+ * @first_entry on, the run having covered [from, to).  Entries the index
+ * already holds are skipped.  A range that would leave a hole between it
+ * and the indexed one is not stored. */
+gboolean
+security_log_index_store (SecurityLogIndex *index,
+                          SecurityLogModel *model,
+                          guint             first_entry,
+                          gint64            from_utime,
+                          gint64            to_utime)
+{
+	guint i, n, n_head;
+	gboolean ret;
+	gint64 covered_from, covered_to;
+	GArray *added;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+
+	if (index->entries) {
+		covered_from = index->header.covered_from;
+		covered_to = index->header.covered_to;
+
+		if (from_utime > covered_to || to_utime < covered_from)
+			return FALSE;
+	} else {
+		covered_from = covered_to = from_utime;
+	}
+
+	added = g_array_new (FALSE, FALSE, sizeof (NewEntry));
+
+	n = security_log_model_get_n_entries (model);
+	for (i = first_entry; i < n; i++) {
+		NewEntry e;
+
+		security_log_model_get_entry (model, i, &e.utime, NULL, NULL, NULL);
+		if (e.utime < from_utime || e.utime >= to_utime)
+			continue;
+		if (e.utime >= covered_from && e.utime < covered_to)
+			continue;
+
+		e.entry = i;
+		g_array_append_val (added, e);
+	}
+
+	g_array_sort (added, compare_new_entry);
+
+	for (n_head = 0; n_head < added->len; n_head++) {
+		if (g_array_index (added, NewEntry, n_head).utime >= covered_from)
+			break;
+	}
+
+	if (!index->entries || from_utime < covered_from) {
+		ret = index_rewrite (index, model,
+                             (NewEntry *)added->data, n_head,
+                             (NewEntry *)added->data + n_head, added->len - n_head,
+                             MIN (from_utime, covered_from), MAX (to_utime, covered_to));
+	} else if (to_utime > covered_to) {
+		ret = index_append (index, model,
+                            (NewEntry *)added->data, added->len,
+                            to_utime);
+	} else {
+		ret = TRUE;
+	}
+
+	g_array_free (added, TRUE);
+
+	return ret;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _SECURITY_LOG_INDEX_H_
+#define _SECURITY_LOG_INDEX_H_
+
+#include "security-log-model.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SecurityLogIndex SecurityLogIndex;
+
+
+SecurityLogIndex *security_log_index_open      (void);
+void              security_log_index_free      (SecurityLogIndex *index);
+
+gboolean          security_log_index_get_range (SecurityLogIndex *index,
+                                                gint64           *from_utime,
+                                                gint64           *to_utime);
+
+guint             security_log_index_load      (SecurityLogIndex *index,
+                                                SecurityLogModel *model,
+                                                gint64            from_utime,
+                                                gint64            to_utime);
+
+gboolean          security_log_index_store     (SecurityLogIndex *index,
+                                                SecurityLogModel *model,
+                                                guint             first_entry,
+                                                gint64            from_utime,
+                                                gint64            to_utime);
+
+G_END_DECLS
+
+#endif /* _SECURITY_LOG_INDEX_H_ */
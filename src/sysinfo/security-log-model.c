@@ -0,0 +1,1097 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "common.h"
+#include "security-log-model.h"
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+
+
+/* indexed by level code, (1 << code) is the matching LOG_LEVEL_* bit */
+static const struct {
+	const char *tr_type;
+	const char *type;
+} LOG_LEVELS[] = {
+	{ "DEBUG"   ,"debug"   },
+	{ "INFO"    ,"info"    },
+	{ "NOTICE"  ,"notice"  },
+	{ "WARNING" ,"warning" },
+	{ "ERR"     ,"err"     },
+	{ "CRIT"    ,"crit"    },
+	{ "ALERT"   ,"alert"   },
+	{ "EMERG"   ,"emerg"   },
+	{ NULL      ,NULL      }
+};
+
+static const char *LOG_CATEGORIES[] = {
+	"os_log",
+	"exe_log",
+	"boot_log",
+	"media_log",
+	"agent_log",
+	NULL
+};
+
+
+/*
+ * Entries are kept column by column in arrival order and the log lines
+ * share one text buffer, so a row costs a few bytes plus its text.  Cell
+ * strings are only produced when the view asks for them.
+ *
+ * 'order' holds every entry sorted by ascending time and 'rows' the
+ * entries passing the filter, in the same order.  The view shows the
+ * newest entry first, so display row i is rows[len - 1 - i].
+ *
+ * For the message search every ASCII case-folded byte trigram of an
+ * entry's description maps to the ascending list of entries holding it,
+ * stored as varint coded deltas.  A query intersects the lists of its
+ * trigrams and only checks the remaining candidates against the text.
+ */
+struct _SecurityLogModelPrivate {
+	gint        stamp;
+
+	GArray     *utimes;
+	GByteArray *levels;
+	GByteArray *categories;
+	GArray     *offsets;
+	GString    *text;
+
+	GArray     *order;
+	GArray     *rows;
+	guint       n_flushed;
+
+	guint       filter_levels;
+	gint64      filter_from;
+	gint64      filter_to;
+
+	GHashTable *trigrams;
+	gchar      *search;
+	GByteArray *matched;
+};
+
+typedef struct {
+	GByteArray *deltas;
+	guint32     last;
+	guint32     count;
+} LogPosting;
+
+
+static void security_log_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (SecurityLogModel, security_log_model, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (SecurityLogModel)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, security_log_model_tree_model_init))
+
+
+#define ENTRY_UTIME(priv,entry) (g_array_index ((priv)->utimes, gint64, (entry)))
+#define ROW_ENTRY(priv,pos)     (g_array_index ((priv)->rows, guint32, (priv)->rows->len - 1 - (pos)))
+#define ENTRY_LINE(priv,entry)  ((priv)->text->str + g_array_index ((priv)->offsets, guint32, (entry)))
+
+#define FOLD(c)    ((guint32)(guchar)g_ascii_tolower (c))
+#define TRIGRAM(p) ((FOLD ((p)[0]) << 16) | (FOLD ((p)[1]) << 8) | FOLD ((p)[2]))
+
+
+static gboolean
+entry_visible (SecurityLogModelPrivate *priv, guint32 entry)
+{
+	gint64 utime = ENTRY_UTIME (priv, entry);
+
+	if (!(priv->filter_levels & (1 << priv->levels->data[entry])))
+		return FALSE;
+
+	if (priv->search && !priv->matched->data[entry])
+		return FALSE;
+
+	return (utime >= priv->filter_from && utime <= priv->filter_to);
+}
+
+static void
+split_line (const gchar  *line,
+            gsize        *date_len,
+            const gchar **time,
+            gsize        *time_len,
+            const gchar **desc)
+{
+	const gchar *sp1, *sp2 = NULL;
+
+	*time = *desc = NULL;
+	*time_len = 0;
+
+	sp1 = strchr (line, ' ');
+	if (!sp1) {
+		*date_len = strlen (line);
+		return;
+	}
+
+	*date_len = sp1 - line;
+	*time = sp1 + 1;
+
+	sp2 = strchr (*time, ' ');
+	if (!sp2) {
+		*time_len = strlen (*time);
+		return;
+	}
+
+	*time_len = sp2 - *time;
+	*desc = sp2 + 1;
+}
+
+static const gchar *
+entry_desc (SecurityLogModelPrivate *priv, guint32 entry)
+{
+	gsize date_len, time_len;
+	const gchar *time, *desc;
+
+	split_line (ENTRY_LINE (priv, entry), &date_len, &time, &time_len, &desc);
+
+	return desc;
+}
+
+static LogPosting *
+posting_new (void)
+{
+	LogPosting *posting = g_new0 (LogPosting, 1);
+
+	posting->deltas = g_byte_array_new ();
+
+	return posting;
+}
+
+static void
+posting_free (gpointer data)
+{
+	LogPosting *posting = data;
+
+	g_byte_array_free (posting->deltas, TRUE);
+	g_free (posting);
+}
+
+static void
+posting_append (LogPosting *posting, guint32 entry)
+{
+	guint8 b;
+	guint32 delta = entry - posting->last;
+
+	while (delta >= 0x80) {
+		b = (delta & 0x7f) | 0x80;
+		g_byte_array_append (posting->deltas, &b, 1);
+		delta >>= 7;
+	}
+
+	b = delta;
+	g_byte_array_append (posting->deltas, &b, 1);
+
+	posting->last = entry;
+	posting->count++;
+}
+
+static void
+posting_decode (const LogPosting *posting, GArray *entries)
+{
+	guint i = 0, k;
+	guint32 entry = 0;
+
+	for (k = 0; k < posting->count; k++) {
+		guint8 b;
+		gint shift = 0;
+		guint32 delta = 0;
+
+		do {
+			b = posting->deltas->data[i++];
+			delta |= (guint32)(b & 0x7f) << shift;
+			shift += 7;
+		} while (b & 0x80);
+
+		entry += delta;
+		g_array_append_val (entries, entry);
+	}
+}
+
+static void
+index_entry (SecurityLogModelPrivate *priv, guint32 entry)
+{
+	gsize i, len;
+	const gchar *desc = entry_desc (priv, entry);
+
+	if (!desc)
+		return;
+
+	len = strlen (desc);
+	for (i = 0; i + 3 <= len; i++) {
+		guint32 key = TRIGRAM (desc + i);
+		LogPosting *posting = g_hash_table_lookup (priv->trigrams, GUINT_TO_POINTER (key));
+
+		if (!posting) {
+			posting = posting_new ();
+			g_hash_table_insert (priv->trigrams, GUINT_TO_POINTER (key), posting);
+		} else if (posting->last == entry && posting->count > 0) {
+			continue;
+		}
+
+		posting_append (posting, entry);
+	}
+}
+
+/* @needle is already folded to lower case */
+static gboolean
+desc_contains (const gchar *desc, const gchar *needle)
+{
+	gsize i;
+
+	if (!desc)
+		return FALSE;
+
+	for (; *desc; desc++) {
+		for (i = 0; needle[i] && g_ascii_tolower (desc[i]) == needle[i]; i++)
+			;
+		if (!needle[i])
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gint
+compare_posting_count (gconstpointer a, gconstpointer b)
+{
+	const LogPosting *pa = *(LogPosting * const *)a;
+	const LogPosting *pb = *(LogPosting * const *)b;
+
+	return (pa->count > pb->count) - (pa->count < pb->count);
+}
+
+/* Keeps the entries of @candidates that are also in @posting. */
+static void
+intersect_posting (GArray *candidates, const LogPosting *posting)
+{
+	guint i, j, k;
+	GArray *entries;
+
+	entries = g_array_sized_new (FALSE, FALSE, sizeof (guint32), posting->count);
+	posting_decode (posting, entries);
+
+	for (i = 0, j = 0, k = 0; i < candidates->len && j < entries->len;) {
+		guint32 a = g_array_index (candidates, guint32, i);
+		guint32 b = g_array_index (entries, guint32, j);
+
+		if (a < b) {
+			i++;
+		} else if (a > b) {
+			j++;
+		} else {
+			g_array_index (candidates, guint32, k++) = a;
+			i++;
+			j++;
+		}
+	}
+	g_array_set_size (candidates, k);
+
+	g_array_free (entries, TRUE);
+}
+
+/* Fills 'matched' for every entry against 'search'. */
+static void
+search_entries (SecurityLogModelPrivate *priv)
+{
+	guint i;
+	gsize len;
+	GPtrArray *postings;
+	GArray *candidates;
+
+	g_byte_array_set_size (priv->matched, priv->utimes->len);
+	memset (priv->matched->data, 0, priv->matched->len);
+
+	len = strlen (priv->search);
+
+	/* too short to have a trigram */
+	if (len < 3) {
+		for (i = 0; i < priv->utimes->len; i++)
+			priv->matched->data[i] = desc_contains (entry_desc (priv, i), priv->search);
+		return;
+	}
+
+	postings = g_ptr_array_new ();
+	for (i = 0; i + 3 <= len; i++) {
+		LogPosting *posting = g_hash_table_lookup (priv->trigrams, GUINT_TO_POINTER (TRIGRAM (priv->search + i)));
+		if (!posting) {
+			g_ptr_array_free (postings, TRUE);
+			return;
+		}
+		g_ptr_array_add (postings, posting);
+	}
+
+	/* start from the rarest trigram; once few candidates are left,
+	 * checking their text is cheaper than decoding more lists */
+	g_ptr_array_sort (postings, compare_posting_count);
+
+	candidates = g_array_new (FALSE, FALSE, sizeof (guint32));
+	posting_decode (g_ptr_array_index (postings, 0), candidates);
+
+	for (i = 1; i < postings->len && candidates->len > 64; i++)
+		intersect_posting (candidates, g_ptr_array_index (postings, i));
+
+	for (i = 0; i < candidates->len; i++) {
+		guint32 entry = g_array_index (candidates, guint32, i);
+		priv->matched->data[entry] = desc_contains (entry_desc (priv, entry), priv->search);
+	}
+
+	g_array_free (candidates, TRUE);
+	g_ptr_array_free (postings, TRUE);
+}
+
+static void
+set_iter (SecurityLogModel *model, GtkTreeIter *iter, guint pos)
+{
+	iter->stamp = model->priv->stamp;
+	iter->user_data = GUINT_TO_POINTER (pos);
+}
+
+static void
+emit_row_inserted (SecurityLogModel *model, guint pos)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+
+	set_iter (model, &iter, pos);
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_deleted (SecurityLogModel *model, guint pos)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+	gtk_tree_path_free (path);
+}
+
+typedef struct {
+	guint32 next;
+	guint32 end;
+} LogRun;
+
+static gboolean
+run_before (SecurityLogModelPrivate *priv, const LogRun *a, const LogRun *b)
+{
+	gint64 ta = ENTRY_UTIME (priv, a->next);
+	gint64 tb = ENTRY_UTIME (priv, b->next);
+
+	if (ta != tb)
+		return (ta < tb);
+
+	return (a->next < b->next);
+}
+
+static void
+run_heap_sift_down (SecurityLogModelPrivate *priv, LogRun *heap, guint n, guint i)
+{
+	while (TRUE) {
+		LogRun tmp;
+		guint l = 2 * i + 1, r = l + 1, m = i;
+
+		if (l < n && run_before (priv, &heap[l], &heap[m]))
+			m = l;
+		if (r < n && run_before (priv, &heap[r], &heap[m]))
+			m = r;
+		if (m == i)
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[m];
+		heap[m] = tmp;
+		i = m;
+	}
+}
+
+/* Appends the entries [first, last) to @batch in ascending time.  The
+ * parser reports each log category in chronological order, so the range
+ * is a few ascending runs, normally one per category; they are merged
+ * through a binary heap in O(n log k) instead of being sorted.  This
+ * only holds while the range is whole categories, which is why entries
+ * are buffered until a fetch completes or a large batch is pending. */
+static void
+merge_runs (SecurityLogModelPrivate *priv, guint32 first, guint32 last, GArray *batch)
+{
+	guint32 i;
+	guint n;
+	LogRun run, *heap;
+	GArray *runs;
+
+	runs = g_array_new (FALSE, FALSE, sizeof (LogRun));
+
+	run.next = first;
+	for (i = first + 1; i <= last; i++) {
+		if (i == last || ENTRY_UTIME (priv, i - 1) > ENTRY_UTIME (priv, i)) {
+			run.end = i;
+			g_array_append_val (runs, run);
+			run.next = i;
+		}
+	}
+
+	heap = (LogRun *)runs->data;
+	n = runs->len;
+
+	for (i = n / 2; i > 0; i--)
+		run_heap_sift_down (priv, heap, n, i - 1);
+
+	while (n > 0) {
+		guint32 entry = heap[0].next++;
+
+		g_array_append_val (batch, entry);
+
+		if (heap[0].next == heap[0].end)
+			heap[0] = heap[--n];
+
+		if (n > 1)
+			run_heap_sift_down (priv, heap, n, 0);
+	}
+
+	g_array_free (runs, TRUE);
+}
+
+/* Merges the ascending @batch into the ascending @array in place.  Only
+ * the part of @array newer than the oldest batch entry is moved.  The
+ * final indices of the merged batch entries are appended to @inserted,
+ * highest index first. */
+static void
+merge_sorted (SecurityLogModelPrivate *priv, GArray *array, GArray *batch, GArray *inserted)
+{
+	gint i, j, k;
+
+	if (batch->len == 0)
+		return;
+
+	i = (gint)array->len - 1;
+	j = (gint)batch->len - 1;
+
+	g_array_set_size (array, array->len + batch->len);
+
+	k = (gint)array->len - 1;
+
+	while (j >= 0) {
+		guint32 b = g_array_index (batch, guint32, j);
+
+		if (i >= 0 && ENTRY_UTIME (priv, g_array_index (array, guint32, i)) > ENTRY_UTIME (priv, b)) {
+			g_array_index (array, guint32, k) = g_array_index (array, guint32, i);
+			i--;
+		} else {
+			g_array_index (array, guint32, k) = b;
+			if (inserted)
+				g_array_append_val (inserted, k);
+			j--;
+		}
+		k--;
+	}
+}
+
+static GtkTreeModelFlags
+security_log_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+security_log_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return SECURITY_LOG_MODEL_N_COLUMNS;
+}
+
+static GType
+security_log_model_get_column_type (GtkTreeModel *tree_model, gint index)
+{
+	switch (index) {
+		case SECURITY_LOG_MODEL_COLUMN_UTIME:
+			return G_TYPE_INT64;
+
+		case SECURITY_LOG_MODEL_COLUMN_LEVEL:
+			return G_TYPE_UINT;
+
+		default:
+			return G_TYPE_STRING;
+	}
+}
+
+static gboolean
+security_log_model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	SecurityLogModel *model = SECURITY_LOG_MODEL (tree_model);
+	gint *indices = gtk_tree_path_get_indices (path);
+
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	if (indices[0] < 0 || (guint)indices[0] >= model->priv->rows->len)
+		return FALSE;
+
+	set_iter (model, iter, indices[0]);
+
+	return TRUE;
+}
+
+static GtkTreePath *
+security_log_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	g_return_val_if_fail (iter->stamp == SECURITY_LOG_MODEL (tree_model)->priv->stamp, NULL);
+
+	return gtk_tree_path_new_from_indices (GPOINTER_TO_UINT (iter->user_data), -1);
+}
+
+static void
+security_log_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	guint32 entry;
+	gsize date_len, time_len;
+	const gchar *line, *time, *desc;
+	SecurityLogModel *model = SECURITY_LOG_MODEL (tree_model);
+	SecurityLogModelPrivate *priv = model->priv;
+
+	g_return_if_fail (iter->stamp == priv->stamp);
+
+	entry = ROW_ENTRY (priv, GPOINTER_TO_UINT (iter->user_data));
+
+	g_value_init (value, security_log_model_get_column_type (tree_model, column));
+
+	switch (column) {
+		case SECURITY_LOG_MODEL_COLUMN_UTIME:
+			g_value_set_int64 (value, ENTRY_UTIME (priv, entry));
+			return;
+
+		case SECURITY_LOG_MODEL_COLUMN_LEVEL:
+			g_value_set_uint (value, 1 << priv->levels->data[entry]);
+			return;
+
+		case SECURITY_LOG_MODEL_COLUMN_TYPE:
+			g_value_set_static_string (value, _(LOG_LEVELS[priv->levels->data[entry]].tr_type));
+			return;
+
+		default:
+		break;
+	}
+
+	line = priv->text->str + g_array_index (priv->offsets, guint32, entry);
+	split_line (line, &date_len, &time, &time_len, &desc);
+
+	switch (column) {
+		case SECURITY_LOG_MODEL_COLUMN_DATE:
+			g_value_take_string (value, g_strndup (line, date_len));
+		break;
+
+		case SECURITY_LOG_MODEL_COLUMN_TIME:
+			if (time)
+				g_value_take_string (value, g_strndup (time, time_len));
+		break;
+
+		case SECURITY_LOG_MODEL_COLUMN_DESC:
+			g_value_set_string (value, desc);
+		break;
+
+		default:
+		break;
+	}
+}
+
+static gboolean
+security_log_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	SecurityLogModel *model = SECURITY_LOG_MODEL (tree_model);
+	guint pos = GPOINTER_TO_UINT (iter->user_data) + 1;
+
+	if (pos >= model->priv->rows->len)
+		return FALSE;
+
+	set_iter (model, iter, pos);
+
+	return TRUE;
+}
+
+static gboolean
+security_log_model_iter_previous (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	SecurityLogModel *model = SECURITY_LOG_MODEL (tree_model);
+	guint pos = GPOINTER_TO_UINT (iter->user_data);
+
+	if (pos == 0)
+		return FALSE;
+
+	set_iter (model, iter, pos - 1);
+
+	return TRUE;
+}
+
+static gboolean
+security_log_model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	SecurityLogModel *model = SECURITY_LOG_MODEL (tree_model);
+
+	if (parent || n < 0 || (guint)n >= model->priv->rows->len)
+		return FALSE;
+
+	set_iter (model, iter, n);
+
+	return TRUE;
+}
+
+static gboolean
+security_log_model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return security_log_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+security_log_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+security_log_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	if (iter)
+		return 0;
+
+	return SECURITY_LOG_MODEL (tree_model)->priv->rows->len;
+}
+
+static gboolean
+security_log_model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void
+security_log_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags       = security_log_model_get_flags;
+	iface->get_n_columns   = security_log_model_get_n_columns;
+	iface->get_column_type = security_log_model_get_column_type;
+	iface->get_iter        = security_log_model_get_iter;
+	iface->get_path        = security_log_model_get_path;
+	iface->get_value       = security_log_model_get_value;
+	iface->iter_next       = security_log_model_iter_next;
+	iface->iter_previous   = security_log_model_iter_previous;
+	iface->iter_children   = security_log_model_iter_children;
+	iface->iter_has_child  = security_log_model_iter_has_child;
+	iface->iter_n_children = security_log_model_iter_n_children;
+	iface->iter_nth_child  = security_log_model_iter_nth_child;
+	iface->iter_parent     = security_log_model_iter_parent;
+}
+
+static void
+security_log_model_finalize (GObject *object)
+{
+	SecurityLogModel *model = SECURITY_LOG_MODEL (object);
+	SecurityLogModelPrivate *priv = model->priv;
+
+	g_array_free (priv->utimes, TRUE);
+	g_byte_array_free (priv->levels, TRUE);
+	g_byte_array_free (priv->categories, TRUE);
+	g_array_free (priv->offsets, TRUE);
+	g_string_free (priv->text, TRUE);
+	g_array_free (priv->order, TRUE);
+	g_array_free (priv->rows, TRUE);
+	g_hash_table_destroy (priv->trigrams);
+	g_byte_array_free (priv->matched, TRUE);
+	g_free (priv->search);
+
+	G_OBJECT_CLASS (security_log_model_parent_class)->finalize (object);
+}
+
+static void
+security_log_model_init (SecurityLogModel *self)
+{
+	SecurityLogModelPrivate *priv;
+
+	priv = self->priv = security_log_model_get_instance_private (self);
+
+	priv->stamp = g_random_int ();
+	priv->utimes = g_array_new (FALSE, FALSE, sizeof (gint64));
+	priv->levels = g_byte_array_new ();
+	priv->categories = g_byte_array_new ();
+	priv->offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->text = g_string_new (NULL);
+	priv->order = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->rows = g_array_new (FALSE, FALSE, sizeof (guint32));
+	priv->n_flushed = 0;
+
+	priv->filter_levels = 0;
+	priv->filter_from = G_MININT64;
+	priv->filter_to = G_MAXINT64;
+
+	priv->trigrams = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, posting_free);
+	priv->search = NULL;
+	priv->matched = g_byte_array_new ();
+}
+
+static void
+security_log_model_class_init (SecurityLogModelClass *class)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+	object_class->finalize = security_log_model_finalize;
+}
+
+SecurityLogModel *
+security_log_model_new (void)
+{
+	return g_object_new (SECURITY_LOG_TYPE_MODEL, NULL);
+}
+
+gint
+security_log_level_from_string (const gchar *type)
+{
+	gint i;
+
+	if (!type)
+		return -1;
+
+	for (i = 0; LOG_LEVELS[i].type != NULL; i++) {
+		if (g_str_equal (type, LOG_LEVELS[i].type))
+			return i;
+	}
+
+	return -1;
+}
+
+gint
+security_log_category_from_key (const gchar *key)
+{
+	gint i;
+
+	for (i = 0; LOG_CATEGORIES[i] != NULL; i++) {
+		if (g_strcmp0 (key, LOG_CATEGORIES[i]) == 0)
+			return i;
+	}
+
+	return SECURITY_LOG_CATEGORY_UNKNOWN;
+}
+
+/* Stores an entry.  It becomes a row on the next security_log_model_flush(). */
+void
+security_log_model_append (SecurityLogModel *model,
+                           gint64            utime,
+                           guint8            level,
+                           guint8            category,
+                           const gchar      *line)
+{
+	guint32 offset;
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+	g_return_if_fail (level < G_N_ELEMENTS (LOG_LEVELS) - 1);
+
+	priv = model->priv;
+
+	g_return_if_fail (priv->text->len < G_MAXUINT32);
+
+	offset = priv->text->len;
+	g_string_append_len (priv->text, line ? line : "", line ? strlen (line) + 1 : 1);
+
+	g_array_append_val (priv->utimes, utime);
+	g_byte_array_append (priv->levels, &level, 1);
+	g_byte_array_append (priv->categories, &category, 1);
+	g_array_append_val (priv->offsets, offset);
+
+	index_entry (priv, priv->utimes->len - 1);
+}
+
+/* Turns the entries appended since the last flush into rows.  Each flush
+ * moves the part of the store newer than the oldest new entry, so callers
+ * flush once per fetch or per large batch, with the view detached when
+ * many rows come in. */
+void
+security_log_model_flush (SecurityLogModel *model)
+{
+	guint i;
+	GArray *batch, *visible, *inserted;
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+
+	priv = model->priv;
+
+	if (priv->n_flushed == priv->utimes->len)
+		return;
+
+	batch = g_array_sized_new (FALSE, FALSE, sizeof (guint32), priv->utimes->len - priv->n_flushed);
+	visible = g_array_new (FALSE, FALSE, sizeof (guint32));
+	inserted = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	if (priv->search) {
+		g_byte_array_set_size (priv->matched, priv->utimes->len);
+		for (i = priv->n_flushed; i < priv->utimes->len; i++)
+			priv->matched->data[i] = desc_contains (entry_desc (priv, i), priv->search);
+	}
+
+	merge_runs (priv, priv->n_flushed, priv->utimes->len, batch);
+
+	for (i = 0; i < batch->len; i++) {
+		guint32 entry = g_array_index (batch, guint32, i);
+		if (entry_visible (priv, entry))
+			g_array_append_val (visible, entry);
+	}
+
+	merge_sorted (priv, priv->order, batch, NULL);
+	merge_sorted (priv, priv->rows, visible, inserted);
+
+	priv->n_flushed = priv->utimes->len;
+	priv->stamp++;
+
+	/* 'inserted' holds rows indices from the highest down, which are
+	 * display positions from the top down.  A detached model has no
+	 * one to tell. */
+	if (g_signal_has_handler_pending (model, g_signal_lookup ("row-inserted", GTK_TYPE_TREE_MODEL), 0, FALSE)) {
+		for (i = 0; i < inserted->len; i++)
+			emit_row_inserted (model, priv->rows->len - 1 - g_array_index (inserted, gint, i));
+	}
+
+	g_array_free (batch, TRUE);
+	g_array_free (visible, TRUE);
+	g_array_free (inserted, TRUE);
+}
+
+/* Number of appended entries the next flush turns into rows. */
+guint
+security_log_model_get_n_pending (SecurityLogModel *model)
+{
+	g_return_val_if_fail (SECURITY_LOG_IS_MODEL (model), 0);
+
+	return model->priv->utimes->len - model->priv->n_flushed;
+}
+
+/* Number of appended entries, flushed or not. */
+guint
+security_log_model_get_n_entries (SecurityLogModel *model)
+{
+	g_return_val_if_fail (SECURITY_LOG_IS_MODEL (model), 0);
+
+	return model->priv->utimes->len;
+}
+
+/* Reads back an appended entry, @entry counting in arrival order. */
+void
+security_log_model_get_entry (SecurityLogModel  *model,
+                              guint              entry,
+                              gint64            *utime,
+                              guint8            *level,
+                              guint8            *category,
+                              const gchar      **line)
+{
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+	g_return_if_fail (entry < model->priv->utimes->len);
+
+	priv = model->priv;
+
+	if (utime)
+		*utime = ENTRY_UTIME (priv, entry);
+	if (level)
+		*level = priv->levels->data[entry];
+	if (category)
+		*category = priv->categories->data[entry];
+	if (line)
+		*line = priv->text->str + g_array_index (priv->offsets, guint32, entry);
+}
+
+/* Forgets every entry appended after the first @n_entries, so a fetch that
+ * is abandoned halfway leaves no rows behind. */
+void
+security_log_model_truncate (SecurityLogModel *model, guint n_entries)
+{
+	gint i;
+	guint j, pos;
+	gpointer value;
+	GHashTableIter iter;
+	GArray *old_rows, *entries;
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+
+	priv = model->priv;
+
+	if (n_entries >= priv->utimes->len)
+		return;
+
+	entries = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	for (i = 0, j = 0; i < (gint)priv->order->len; i++) {
+		guint32 entry = g_array_index (priv->order, guint32, i);
+		if (entry < n_entries)
+			g_array_index (priv->order, guint32, j++) = entry;
+	}
+	g_array_set_size (priv->order, j);
+
+	old_rows = priv->rows;
+	priv->rows = g_array_sized_new (FALSE, FALSE, sizeof (guint32), old_rows->len);
+	for (i = 0; i < (gint)old_rows->len; i++) {
+		guint32 entry = g_array_index (old_rows, guint32, i);
+		if (entry < n_entries)
+			g_array_append_val (priv->rows, entry);
+	}
+
+	g_string_truncate (priv->text, g_array_index (priv->offsets, guint32, n_entries));
+	g_array_set_size (priv->utimes, n_entries);
+	g_byte_array_set_size (priv->levels, n_entries);
+	g_byte_array_set_size (priv->categories, n_entries);
+	g_array_set_size (priv->offsets, n_entries);
+	priv->n_flushed = MIN (priv->n_flushed, n_entries);
+
+	if (priv->matched->len > n_entries)
+		g_byte_array_set_size (priv->matched, n_entries);
+
+	g_hash_table_iter_init (&iter, priv->trigrams);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		LogPosting *posting = value;
+
+		if (posting->last < n_entries)
+			continue;
+
+		g_array_set_size (entries, 0);
+		posting_decode (posting, entries);
+
+		g_byte_array_set_size (posting->deltas, 0);
+		posting->last = posting->count = 0;
+
+		for (j = 0; j < entries->len && g_array_index (entries, guint32, j) < n_entries; j++)
+			posting_append (posting, g_array_index (entries, guint32, j));
+
+		if (posting->count == 0)
+			g_hash_table_iter_remove (&iter);
+	}
+
+	priv->stamp++;
+
+	/* as in refilter(), report from the top of the view */
+	pos = 0;
+	for (i = (gint)old_rows->len - 1; i >= 0; i--) {
+		if (g_array_index (old_rows, guint32, i) >= n_entries)
+			emit_row_deleted (model, pos);
+		else
+			pos++;
+	}
+
+	g_array_free (old_rows, TRUE);
+	g_array_free (entries, TRUE);
+}
+
+/* Rebuilds 'rows' after a filter change and tells the view which rows
+ * left or came back. */
+static void
+refilter (SecurityLogModel *model)
+{
+	gint i, oi;
+	guint pos;
+	GArray *old_rows;
+	SecurityLogModelPrivate *priv = model->priv;
+
+	old_rows = priv->rows;
+	priv->rows = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	for (i = 0; i < (gint)priv->n_flushed; i++) {
+		guint32 entry = g_array_index (priv->order, guint32, i);
+		if (entry_visible (priv, entry))
+			g_array_append_val (priv->rows, entry);
+	}
+
+	priv->stamp++;
+
+	/* Walk from the top of the view.  Rows above the current one are
+	 * already in their new state, so 'pos' is both the position to
+	 * report and the row's final position. */
+	pos = 0;
+	oi = (gint)old_rows->len - 1;
+	for (i = (gint)priv->n_flushed - 1; i >= 0; i--) {
+		guint32 entry = g_array_index (priv->order, guint32, i);
+		gboolean was_visible = (oi >= 0 && g_array_index (old_rows, guint32, oi) == entry);
+		gboolean is_visible = entry_visible (priv, entry);
+
+		if (was_visible)
+			oi--;
+
+		if (was_visible && !is_visible) {
+			emit_row_deleted (model, pos);
+		} else if (!was_visible && is_visible) {
+			emit_row_inserted (model, pos);
+			pos++;
+		} else if (is_visible) {
+			pos++;
+		}
+	}
+
+	g_array_free (old_rows, TRUE);
+}
+
+void
+security_log_model_set_filter (SecurityLogModel *model,
+                               guint             levels,
+                               gint64            from_utime,
+                               gint64            to_utime)
+{
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+
+	priv = model->priv;
+
+	if (priv->filter_levels == levels &&
+        priv->filter_from == from_utime &&
+        priv->filter_to == to_utime)
+		return;
+
+	priv->filter_levels = levels;
+	priv->filter_from = from_utime;
+	priv->filter_to = to_utime;
+
+	refilter (model);
+}
+
+/* Only shows entries whose description contains @text, ignoring ASCII
+ * case.  NULL or an empty @text shows them all again. */
+void
+security_log_model_set_search (SecurityLogModel *model, const gchar *text)
+{
+	gchar *search = NULL;
+	SecurityLogModelPrivate *priv;
+
+	g_return_if_fail (SECURITY_LOG_IS_MODEL (model));
+
+	priv = model->priv;
+
+	if (text && *text)
+		search = g_ascii_strdown (text, -1);
+
+	if (g_strcmp0 (search, priv->search) == 0) {
+		g_free (search);
+		return;
+	}
+
+	g_free (priv->search);
+	priv->search = search;
+
+	if (priv->search)
+		search_entries (priv);
+
+	refilter (model);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _SECURITY_LOG_MODEL_H_
+#define _SECURITY_LOG_MODEL_H_
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define SECURITY_LOG_TYPE_MODEL            (security_log_model_get_type ())
+#define SECURITY_LOG_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SECURITY_LOG_TYPE_MODEL, SecurityLogModel))
+#define SECURITY_LOG_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), SECURITY_LOG_TYPE_MODEL, SecurityLogModelClass))
+#define SECURITY_LOG_IS_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SECURITY_LOG_TYPE_MODEL))
+#define SECURITY_LOG_IS_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), SECURITY_LOG_TYPE_MODEL))
+#define SECURITY_LOG_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), SECURITY_LOG_TYPE_MODEL, SecurityLogModelClass))
+
+/* level codes run from 0 (debug) to 7 (emerg) */
+#define SECURITY_LOG_N_LEVELS              8
+
+typedef struct _SecurityLogModel        SecurityLogModel;
+typedef struct _SecurityLogModelClass   SecurityLogModelClass;
+typedef struct _SecurityLogModelPrivate SecurityLogModelPrivate;
+
+
+struct _SecurityLogModel {
+	GObject __parent__;
+
+	SecurityLogModelPrivate *priv;
+};
+
+struct _SecurityLogModelClass {
+	GObjectClass __parent_class__;
+};
+
+enum {
+	SECURITY_LOG_MODEL_COLUMN_DATE,
+	SECURITY_LOG_MODEL_COLUMN_TIME,
+	SECURITY_LOG_MODEL_COLUMN_TYPE,
+	SECURITY_LOG_MODEL_COLUMN_DESC,
+	SECURITY_LOG_MODEL_COLUMN_UTIME,
+	SECURITY_LOG_MODEL_COLUMN_LEVEL,
+	SECURITY_LOG_MODEL_N_COLUMNS
+};
+
+enum {
+	SECURITY_LOG_CATEGORY_OS,
+	SECURITY_LOG_CATEGORY_EXE,
+	SECURITY_LOG_CATEGORY_BOOT,
+	SECURITY_LOG_CATEGORY_MEDIA,
+	SECURITY_LOG_CATEGORY_AGENT,
+	SECURITY_LOG_CATEGORY_UNKNOWN
+};
+
+
+GType             security_log_model_get_type    (void) G_GNUC_CONST;
+
+SecurityLogModel *security_log_model_new         (void);
+
+gint              security_log_level_from_string (const gchar      *type);
+gint              security_log_category_from_key (const gchar      *key);
+
+void              security_log_model_append      (SecurityLogModel *model,
+                                                  gint64            utime,
+                                                  guint8            level,
+                                                  guint8            category,
+                                                  const gchar      *line);
+
+void              security_log_model_flush       (SecurityLogModel *model);
+guint             security_log_model_get_n_pending (SecurityLogModel *model);
+
+guint             security_log_model_get_n_entries (SecurityLogModel *model);
+void              security_log_model_get_entry   (SecurityLogModel *model,
+                                                  guint             entry,
+                                                  gint64           *utime,
+                                                  guint8           *level,
+                                                  guint8           *category,
+                                                  const gchar     **line);
+void              security_log_model_truncate    (SecurityLogModel *model,
+                                                  guint             n_entries);
+
+void              security_log_model_set_filter  (SecurityLogModel *model,
+                                                  guint             levels,
+                                                  gint64            from_utime,
+                                                  gint64            to_utime);
+
+void              security_log_model_set_search  (SecurityLogModel *model,
+                                                  const gchar      *text);
+
+G_END_DECLS
+
+#endif /* _SECURITY_LOG_MODEL_H_ */
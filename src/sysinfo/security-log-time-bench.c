@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmarks security_log_time_parse() against the conversion it
+ * replaced (g_strsplit, sscanf and a GDateTime per line) on a million
+ * synthetic log lines spread over a year, so both DST changes of the
+ * zone are crossed.  Reports lines per second and heap use of each,
+ * and fails if they disagree on any line.
+ */
+
+#include "bench-alloc.h"
+#include "security-log-time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define BENCH_LINES       1000000
+#define BENCH_STEP        29        /* seconds of wall clock between lines */
+#define BENCH_TIMEZONE    "Europe/Berlin"
+
+
+/* What the log entry callback did before security_log_time_parse(). */
+static gint64
+reference_parse (const gchar *line)
+{
+	gint64 utime = 0;
+	GDateTime *dt = NULL;
+	gint yy = 0, mm = 0, dd = 0, h = 0, m = 0, s = 0;
+	gchar **tokens = g_strsplit (line, " ", -1);
+
+	if (tokens[0])
+		sscanf (tokens[0], "%d-%d-%d", &yy, &mm, &dd);
+	if (tokens[0] && tokens[1])
+		sscanf (tokens[1], "%d:%d:%d", &h, &m, &s);
+
+	dt = g_date_time_new_local (yy, mm, dd, h, m, s);
+	if (dt) {
+		utime = g_date_time_to_unix (dt);
+		g_date_time_unref (dt);
+	}
+
+	g_strfreev (tokens);
+
+	return utime;
+}
+
+/* Log lines as the parser writes them, NUL-separated in one block. */
+static gchar *
+lines_new (GArray *offsets)
+{
+	guint i;
+	gint year = 2024, month = 1, day = 1, secs = 7;
+	GString *text = g_string_new (NULL);
+
+	for (i = 0; i < BENCH_LINES; i++) {
+		guint32 offset = text->len;
+
+		g_array_append_val (offsets, offset);
+		g_string_append_printf (text, "%04d-%02d-%02d %02d:%02d:%02d gooroom kernel: [GRMCODE=%06u] line %u",
+                                year, month, day, secs / 3600, secs / 60 % 60, secs % 60, i % 1000000, i);
+		g_string_append_c (text, '\0');
+
+		secs += BENCH_STEP;
+		if (secs >= 86400) {
+			secs -= 86400;
+			if (++day > g_date_get_days_in_month (month, year)) {
+				day = 1;
+				if (++month > 12) {
+					month = 1;
+					year++;
+				}
+			}
+		}
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+report (const gchar *name, gint64 usec, const BenchAllocStats *stats)
+{
+	gdouble seconds = (gdouble) usec / G_USEC_PER_SEC;
+
+	g_print ("%-7s %8u lines %10.1f ms %12.0f lines/s %10.1f KiB peak %10" G_GUINT64_FORMAT " allocs\n",
+             name, BENCH_LINES, seconds * 1000, BENCH_LINES / seconds,
+             stats->peak / 1024.0, stats->count);
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i, mismatches = 0, first_mismatch = 0, non_uniform = 0;
+	gchar *text;
+	gint64 *expected, start, before, after;
+	GArray *offsets;
+	BenchAllocStats stats;
+	SecurityLogDayCache cache = { 0, };
+
+	/* a zone with DST unless one was asked for */
+	if (!g_getenv ("TZ"))
+		g_setenv ("TZ", BENCH_TIMEZONE, TRUE);
+
+	offsets = g_array_sized_new (FALSE, FALSE, sizeof (guint32), BENCH_LINES);
+	text = lines_new (offsets);
+	expected = g_new (gint64, BENCH_LINES);
+
+	bench_alloc_reset ();
+	start = g_get_monotonic_time ();
+	for (i = 0; i < BENCH_LINES; i++)
+		expected[i] = reference_parse (text + g_array_index (offsets, guint32, i));
+	before = g_get_monotonic_time () - start;
+	bench_alloc_get (&stats);
+
+	report ("before", before, &stats);
+
+	bench_alloc_reset ();
+	start = g_get_monotonic_time ();
+	for (i = 0; i < BENCH_LINES; i++) {
+		if (security_log_time_parse (text + g_array_index (offsets, guint32, i), &cache) != expected[i] &&
+            mismatches++ == 0)
+			first_mismatch = i;
+		if (!cache.uniform)
+			non_uniform++;
+	}
+	after = g_get_monotonic_time () - start;
+	bench_alloc_get (&stats);
+
+	report ("after", after, &stats);
+
+	g_print ("speedup %.1fx, %u lines on days with an offset change\n",
+             (gdouble) before / MAX (after, 1), non_uniform);
+
+	if (mismatches > 0)
+		g_printerr ("%u lines disagree, the first at \"%.19s\"\n",
+                    mismatches, text + g_array_index (offsets, guint32, first_mismatch));
+
+	g_free (expected);
+	g_free (text);
+	g_array_free (offsets, TRUE);
+
+	return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "security-log-time.h"
+
+
+static gboolean
+scan_number (const gchar **p, gint max_digits, gint *value)
+{
+	gint v = 0, n = 0;
+
+	while (n < max_digits && g_ascii_isdigit (**p)) {
+		v = v * 10 + (**p - '0');
+		(*p)++;
+		n++;
+	}
+
+	*value = v;
+
+	return (n > 0);
+}
+
+static gboolean
+scan_separator (const gchar **p, gchar c)
+{
+	if (**p != c)
+		return FALSE;
+
+	(*p)++;
+
+	return TRUE;
+}
+
+/* Converts the leading "YYYY-MM-DD HH:MM:SS" of a log line to Unix time
+ * without allocating.  Local midnight is looked up once per day; only a
+ * day with an offset change (DST) falls back to GDateTime per line. */
+gint64
+security_log_time_parse (const gchar *line, SecurityLogDayCache *cache)
+{
+	const gchar *p = line;
+	gint yy, mm, dd, h, m, s;
+
+	if (!line ||
+        !scan_number (&p, 4, &yy) || !scan_separator (&p, '-') ||
+        !scan_number (&p, 2, &mm) || !scan_separator (&p, '-') ||
+        !scan_number (&p, 2, &dd) || !scan_separator (&p, ' ') ||
+        !scan_number (&p, 2, &h)  || !scan_separator (&p, ':') ||
+        !scan_number (&p, 2, &m)  || !scan_separator (&p, ':') ||
+        !scan_number (&p, 2, &s))
+		return 0;
+
+	if (!cache->valid || cache->year != yy || cache->month != mm || cache->day != dd) {
+		GDateTime *start = g_date_time_new_local (yy, mm, dd, 0, 0, 0);
+		GDateTime *end = g_date_time_new_local (yy, mm, dd, 23, 59, 59);
+
+		cache->valid = (start && end);
+		if (cache->valid) {
+			cache->year = yy;
+			cache->month = mm;
+			cache->day = dd;
+			cache->day_start = g_date_time_to_unix (start);
+			cache->uniform = (g_date_time_get_utc_offset (start) == g_date_time_get_utc_offset (end));
+		}
+
+		if (start) g_date_time_unref (start);
+		if (end) g_date_time_unref (end);
+
+		if (!cache->valid)
+			return 0;
+	}
+
+	if (!cache->uniform) {
+		gint64 utime = 0;
+		GDateTime *dt = g_date_time_new_local (yy, mm, dd, h, m, s);
+		if (dt) {
+			utime = g_date_time_to_unix (dt);
+			g_date_time_unref (dt);
+		}
+		return utime;
+	}
+
+	return cache->day_start + h * 3600 + m * 60 + s;
+}
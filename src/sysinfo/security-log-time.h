@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2018-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _SECURITY_LOG_TIME_H_
+#define _SECURITY_LOG_TIME_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Local midnight of the last day seen, start zeroed. */
+typedef struct {
+	gint     year;
+	gint     month;
+	gint     day;
+	gint64   day_start;
+	gboolean uniform;
+	gboolean valid;
+} SecurityLogDayCache;
+
+
+gint64 security_log_time_parse (const gchar         *line,
+                                SecurityLogDayCache *cache);
+
+G_END_DECLS
+
+#endif /* _SECURITY_LOG_TIME_H_ */
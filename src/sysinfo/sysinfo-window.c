@@ -18,12 +18,19 @@
  */
 
 #include "common.h"
+#include "command-runner.h"
 #include "rpd-dialog.h"
 #include "calendar-popover.h"
 #include "logfilter-popover.h"
+#include "security-log-model.h"
+#include "security-log-index.h"
+#include "security-log-time.h"
+#include "firewall-ruleset.h"
+#include "firewall-rule-model.h"
 #include "sysinfo-window.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/utsname.h> 
 #include <shadow.h>
 #include <sys/ioctl.h>
@@ -42,35 +49,59 @@
 
 #define GRM_USER                                 ".grm-user"
 
-#define	UPDATE_PACKAGES_CHECK_TIMEOUT			 60000
-#define	AGENT_CONNECTION_STATUS_CHECK_TIMEOUT	 10000
-
+#define	UPDATE_PACKAGES_CHECK_TIMEOUT			 21600 /* sec */
+#define	UPDATE_PACKAGES_CHECK_DEBOUNCE			 5   /* sec */
+#define	AGENT_HEARTBEAT_INTERVAL				 10  /* sec */
+#define	AGENT_HEARTBEAT_MAX_INTERVAL			 300 /* sec */
+#define	AGENT_HEARTBEAT_HIDDEN_INTERVAL			 120 /* sec */
+#define	AGENT_HEARTBEAT_MAX_BACKOFF				 5   /* doublings */
+#define	COMMAND_TIMEOUT							 30  /* sec */
+#define	PRIVILEGED_PROBE_TIMEOUT				 120 /* sec, it may wait for authentication */
+#define	FIREWALL_CHECK_INTERVAL					 30  /* sec */
+#define	SECURITY_LOG_FLUSH_BATCH				 65536 /* entries shown while a fetch runs */
+#define	SECURITY_LOG_DETACH_MIN					 1024  /* entries loaded with the view detached */
+
+
+#define DPKG_STATUS_FILE                         "/var/lib/dpkg/status"
+#define APT_LISTS_DIR                            "/var/lib/apt/lists"
 #define GOOROOM_SECURITY_STATUS_VULNERABLE       "/var/tmp/GOOROOM-SECURITY-STATUS-VULNERABLE"
 #define GOOROOM_SECURITY_LOGPARSER_NEXT_SEEKTIME "/var/tmp/GOOROOM-SECURITY-LOGPARSER-NEXT-SEEKTIME"
 
 
-static struct {
-	const char *tr_type;
-	const char *type;
-	guint level;
-} LOG_DATA[] = {
-	{ "DEBUG"   ,"debug"   ,LOG_LEVEL_DEBUG   },
-	{ "INFO"    ,"info"    ,LOG_LEVEL_INFO    },
-	{ "NOTICE"  ,"notice"  ,LOG_LEVEL_NOTICE  },
-	{ "WARNING" ,"warning" ,LOG_LEVEL_WARNING },
-	{ "ERR"     ,"err"     ,LOG_LEVEL_ERR     },
-	{ "CRIT"    ,"crit"    ,LOG_LEVEL_CRIT    },
-	{ "ALERT"   ,"alert"   ,LOG_LEVEL_ALERT   },
-	{ "EMERG"   ,"emerg"   ,LOG_LEVEL_EMERG   },
-	{ NULL      ,NULL      ,0                 }
-};
+typedef struct {
+	SysinfoWindow       *window;
+	GCancellable        *cancellable;
+	SecurityLogDayCache  day_cache;
+
+	/* model entries from this index on were added by this fetch */
+	guint                first_entry;
+
+	/* rows outside [keep_from, keep_to) or inside the already cached
+	 * [skip_from, skip_to) are dropped */
+	gint64               keep_from;
+	gint64               keep_to;
+	gint64               skip_from;
+	gint64               skip_to;
+} SecurityLogFetch;
+
+typedef struct {
+	SysinfoWindow       *window;
+	json_object         *members;
+	gchar               *seektime;
+
+	/* set when the shared parser run starts before @seektime: the
+	 * summary is then worked out from the entries since @seek_utime */
+	gboolean             recount;
+	gint64               seek_utime;
+	SecurityLogDayCache  day_cache;
+	guint                levels[SECURITY_LOG_CATEGORY_AGENT];
+} SecurityStatusFetch;
 
 
 
 static void     log_filter_clicked_cb        (GtkToggleButton *button, gpointer data);
 static void     btn_calendar_to_clicked_cb   (GtkToggleButton *button, gpointer data);
 static void     btn_calendar_from_clicked_cb (GtkToggleButton *button, gpointer data);
-static void     run_iptables_command         (const char *command, SysinfoWindow *window);
 static gboolean on_push_update_changed       (GtkSwitch *widget, gboolean state, gpointer data);
 
 
@@ -96,13 +127,25 @@ struct _SysinfoWindowPrivate {
 	GtkWidget *lbl_firewall4_policy;
 	GtkWidget *scl_firewall4;
 	GtkWidget *trv_firewall4;
+	GtkWidget *box_firewall4_filter;
+	GtkWidget *cmb_firewall4_chain;
+	GtkWidget *cmb_firewall4_target;
+	GtkWidget *ent_firewall4_search;
 	GtkWidget *lbl_firewall6;
 	GtkWidget *lbl_firewall6_policy;
 	GtkWidget *scl_firewall6;
 	GtkWidget *trv_firewall6;
+	GtkWidget *box_firewall6_filter;
+	GtkWidget *cmb_firewall6_chain;
+	GtkWidget *cmb_firewall6_target;
+	GtkWidget *ent_firewall6_search;
 	GtkWidget *trv_security_log;
 	GtkWidget *lbl_sec_status;
 
+	SecurityLogModel *log_model;
+	FirewallRuleModel *firewall_model4;
+	FirewallRuleModel *firewall_model6;
+
 	GtkWidget *lbl_search_date_from;
 	GtkWidget *lbl_search_date_to;
 
@@ -147,13 +190,23 @@ struct _SysinfoWindowPrivate {
 	GtkWidget *lbl_update;
 	GtkWidget *swt_push_update;
 	GtkWidget *btn_log_filter;
+	GtkWidget *ent_log_search;
 
 	CalendarPopover *calendar_popover;
 	LogfilterPopover *logfilter_popover;
 
 	guint agent_check_timeout_id;
+	guint agent_heartbeat_failures;
+	gboolean agent_heartbeat_in_flight;
+	gboolean hidden;
 	guint update_check_timeout_id;
+	guint update_check_debounce_id;
+	GList *update_monitors;
+	guint firewall_check_timeout_id;
+	gchar *firewall_fingerprint4;
+	gchar *firewall_fingerprint6;
 	guint prev_log_filter;
+	guint log_filter;
 
 	guint security_status;
 	guint security_item_run;
@@ -166,10 +219,26 @@ struct _SysinfoWindowPrivate {
 	gint64 search_to_utime;
 	gint64 search_from_utime;
 
+	/* range of the log store: every entry in [from, to) has been fetched */
+	gint64 log_cache_from;
+	gint64 log_cache_to;
+
+	/* outstanding agent requests and commands, cancelled on finalize */
+	GCancellable *cancellable;
+
+	/* the parser run still filling the log store, if any */
+	SecurityLogFetch *log_fetch;
+
+	SecurityLogIndex *log_index;
+
 	gboolean standalone_mode;
 
-	gboolean iptable_cmd_lock;
-	gboolean setting_ipv4;
+
+	/* sections of the privileged probe, only set while they are applied */
+	GHashTable *probe;
+	gint probe_vulnerable;
+	gboolean probe_running;
+	gboolean status_waiting;
 
 	gboolean log_date_from;
 };
@@ -193,22 +262,30 @@ str_compare_func (gconstpointer a, gconstpointer b)
 	return ret;
 }
 
-static void
-g_spawn_async_done_cb (GPid pid, gint status, gpointer data)
+/* Output is NUL-terminated, or NULL if the command failed.  Returns
+ * FALSE if the window is gone. */
+static gboolean
+command_output_get (GAsyncResult *res, gchar **output)
 {
-	g_spawn_close_pid (pid);
-}
+	GBytes *bytes;
+	GError *error = NULL;
 
-static void
-iptables_command_done_cb (GPid pid, gint status, gpointer data)
-{
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	*output = NULL;
+
+	bytes = command_runner_finish (res, NULL, &error);
+	if (!bytes) {
+		gboolean cancelled = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+		g_error_free (error);
+		return !cancelled;
+	}
 
-	g_spawn_close_pid (pid);
+	*output = g_strndup (g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes));
+	g_bytes_unref (bytes);
 
-	window->priv->iptable_cmd_lock = FALSE;
+	return TRUE;
 }
 
+
 static gchar *
 stripped_double_quoations (const char *str)
 {
@@ -281,18 +358,36 @@ get_log_search_date (SysinfoWindow *window, gint *year, gint *month, gint *day,
 }
 
 static gchar *
-seek_time_get (SysinfoWindow *window)
+seek_time_get (gint64 utime)
 {
-	SysinfoWindowPrivate *priv = window->priv;
-
-	gint y = DEFAULT_YEAR, m = DEFAULT_MONTH, d = DEFAULT_DAY;
-	get_log_search_date (window, &y, &m, &d, TRUE);
+	gchar *timestamp = NULL;
+	GDateTime *dt = g_date_time_new_from_unix_local (utime);
 
-	gchar *timestamp = g_strdup_printf ("%d%02d%02d-000000.000000", y, m, d);
+	if (dt) {
+		timestamp = g_date_time_format (dt, "%Y%m%d-%H%M%S.000000");
+		g_date_time_unref (dt);
+	}
 
 	return timestamp;
 }
 
+static gint64
+seek_time_to_utime (const gchar *seektime)
+{
+	gint64 utime = 0;
+	gint yy, mm, dd, h, m, s;
+
+	if (seektime && sscanf (seektime, "%4d%2d%2d-%2d%2d%2d", &yy, &mm, &dd, &h, &m, &s) == 6) {
+		GDateTime *dt = g_date_time_new_local (yy, mm, dd, h, m, s);
+		if (dt) {
+			utime = g_date_time_to_unix (dt);
+			g_date_time_unref (dt);
+		}
+	}
+
+	return utime;
+}
+
 static void
 on_togglebutton_state_changed (GtkToggleButton *button, gpointer data)
 {
@@ -376,78 +471,42 @@ set_password_max_day (int maxdays, SysinfoWindow *window)
 	g_free (text);
 }
 
-static gboolean
-parse_chage_l_cb (GIOChannel   *source,
-                  GIOCondition  condition,
-                  gpointer      data)
-{
-	gchar buff[1024] = {0, };
-	gsize bytes_read;
-	GString *outputs = g_string_new ("");
-
-	while (g_io_channel_read_chars (source, buff, sizeof (buff), &bytes_read, NULL) == G_IO_STATUS_NORMAL)
-		outputs = g_string_append_len (outputs, buff, bytes_read);
-
-	guint i = 0;
-	gchar **lines = g_strsplit (outputs->str, "\n", -1);
-	for (i = 0; i < g_strv_length (lines); i++) {
-		if (g_str_has_prefix (lines[i], "Maximum number of days between password change")) {
-			gchar **tokens = g_strsplit (lines[i], ":", -1);
-			if (tokens[1] != NULL) {
-				int maxdays = 99999;
-				maxdays = atoi (g_strstrip (tokens[1]));
-				set_password_max_day (maxdays, SYSINFO_WINDOW (data));
-				break;
-			}
-			g_strfreev (tokens);
-		}
-	}
-	g_strfreev (lines);
+static void
+parse_chage_l_cb (const gchar *line, gpointer data)
+{
+	const gchar *value;
 
-	return FALSE;
+	if (!g_str_has_prefix (line, "Maximum number of days between password change"))
+		return;
+
+	value = strchr (line, ':');
+	if (value)
+		set_password_max_day (atoi (value + 1), SYSINFO_WINDOW (data));
 }
 
 static void
-set_password_max_days_from_command (SysinfoWindow *window)
+chage_l_done_cb (GObject *source, GAsyncResult *res, gpointer data)
 {
-	GPid pid;
-	gint stdout_fd;
-	gchar *cmd, *cmdline;
-    gchar **arr_cmd, **envp;
-
-	cmd = g_find_program_in_path ("chage");
-	cmdline = g_strdup_printf ("%s -l %s", cmd, g_get_user_name ());
+	gchar *output;
 
-	arr_cmd = g_strsplit (cmdline, " ", -1);
-	envp = g_environ_setenv (envp, "LANG", "C", TRUE);
+	command_output_get (res, &output);
+	g_free (output);
+}
 
-	if (g_spawn_async_with_pipes (NULL,
-                                  arr_cmd,
-                                  envp,
-                                  G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                  NULL,
-                                  NULL,
-                                  &pid,
-                                  NULL,
-                                  &stdout_fd,
-                                  NULL,
-                                  NULL)) {
+static void
+set_password_max_days_from_command (SysinfoWindow *window)
+{
+	const gchar *env[] = { "LANG=C", NULL };
+	const gchar *argv[] = { "chage", "-l", g_get_user_name (), NULL };
+	CommandRunnerOptions options = { 0, };
 
-		g_child_watch_add (pid, (GChildWatchFunc)g_spawn_async_done_cb, NULL);
+	options.timeout = COMMAND_TIMEOUT;
+	options.env = env;
+	options.line_func = parse_chage_l_cb;
+	options.func_data = window;
 
-		GIOChannel *io_channel = g_io_channel_unix_new (stdout_fd);
-		g_io_channel_set_flags (io_channel, G_IO_FLAG_NONBLOCK, NULL);
-		g_io_channel_set_encoding (io_channel, NULL, NULL);
-		g_io_channel_set_buffered (io_channel, FALSE);
-		g_io_channel_set_close_on_unref (io_channel, TRUE);
-		g_io_add_watch (io_channel, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP, (GIOFunc) parse_chage_l_cb, window);
-		g_io_channel_unref (io_channel);
-	}
-
-	g_free (cmd);
-	g_free (cmdline);
-	g_strfreev (envp);
-	g_strfreev (arr_cmd);
+	command_runner_spawn_async (argv, &options, window->priv->cancellable,
+                                chage_l_done_cb, window);
 }
 
 static int
@@ -516,275 +575,240 @@ accel_init (SysinfoWindow *window)
     gtk_window_add_accel_group (GTK_WINDOW(window), accel_group);
 }
 
+static guint
+agent_heartbeat_setting (SysinfoWindow *window, const gchar *key, guint fallback)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+
+	if (!priv->settings)
+		return fallback;
+
+	return MAX (g_settings_get_uint (priv->settings, key), 1);
+}
+
+static gboolean agent_heartbeat_send (gpointer data);
+
+/* Only one heartbeat is ever in flight.  The next one is scheduled when
+ * it completes: the configured interval while connected, doubled for
+ * every failed check up to a maximum, and stretched while the window
+ * is hidden. */
 static void
-done_agent_proxy_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+agent_heartbeat_schedule (SysinfoWindow *window)
+{
+	guint interval, max_interval;
+	SysinfoWindowPrivate *priv = window->priv;
+
+	if (priv->agent_check_timeout_id != 0) {
+		g_source_remove (priv->agent_check_timeout_id);
+		priv->agent_check_timeout_id = 0;
+	}
+
+	if (priv->agent_heartbeat_in_flight)
+		return;
+
+	interval = agent_heartbeat_setting (window, "heartbeat-interval", AGENT_HEARTBEAT_INTERVAL);
+	max_interval = agent_heartbeat_setting (window, "heartbeat-max-interval", AGENT_HEARTBEAT_MAX_INTERVAL);
+
+	if (priv->agent_heartbeat_failures > 0) {
+		guint shift = MIN (priv->agent_heartbeat_failures, AGENT_HEARTBEAT_MAX_BACKOFF);
+		interval = MIN ((guint64) interval << shift, MAX (max_interval, interval));
+	}
+
+	if (priv->hidden)
+		interval = MAX (interval, agent_heartbeat_setting (window, "heartbeat-hidden-interval",
+                                                          AGENT_HEARTBEAT_HIDDEN_INTERVAL));
+
+	priv->agent_check_timeout_id = g_timeout_add_seconds (interval, agent_heartbeat_send, window);
+}
+
+static void
+agent_heartbeat_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
 	gchar *status = NULL;
-	GVariant *variant, *v;
+	GError *error = NULL;
+	json_object *out_obj;
+	gboolean connected = FALSE;
+
+	out_obj = agent_do_task_finish (res, &error);
+	if (!out_obj && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+	g_clear_error (&error);
 
 	SysinfoWindow *window = SYSINFO_WINDOW (user_data);
 	SysinfoWindowPrivate *priv = window->priv;
 
-	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
-
-	variant = g_dbus_proxy_call_finish (proxy, res, NULL);
-
-	if (variant) {
-		g_variant_get (variant, "(v)", &v);
-		gchar *data = g_variant_dup_string (v, NULL);
-		g_variant_unref (v);
-		g_variant_unref (variant);
-
-		if (data) {
-			enum json_tokener_error jerr = json_tokener_success;
-			json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-
-			if (jerr == json_tokener_success) {
-				json_object *obj1 = NULL, *obj2 = NULL, *obj3 = NULL, *obj4 = NULL;
-				obj1 = JSON_OBJECT_GET (root_obj, "module");
-				obj2 = JSON_OBJECT_GET (obj1, "task");
-				obj3 = JSON_OBJECT_GET (obj2, "out");
-				obj4 = JSON_OBJECT_GET (obj3, "status");
-				if (obj4) {
-					const char *val = json_object_get_string (obj4);
-					if (val && g_strcmp0 (val, "200") == 0) {
-						status = g_strdup (_("Connected"));
-					} else {
-						status = g_strdup (_("Disconnected"));
-					}
-				}
-				json_object_put (root_obj);
+	if (out_obj) {
+		json_object *obj = JSON_OBJECT_GET (out_obj, "status");
+		if (obj) {
+			const char *val = json_object_get_string (obj);
+			if (val && g_strcmp0 (val, "200") == 0) {
+				status = g_strdup (_("Connected"));
+				connected = TRUE;
+			} else {
+				status = g_strdup (_("Disconnected"));
 			}
 		}
-
-		g_free (data);
+		json_object_put (out_obj);
 	}
 
-	g_object_unref (proxy);
-
 	gtk_label_set_text (GTK_LABEL (priv->lbl_conn_status), (status != NULL) ? status : _("Unknown"));
 
 	g_free (status);
+
+	priv->agent_heartbeat_in_flight = FALSE;
+	priv->agent_heartbeat_failures = connected ? 0 : priv->agent_heartbeat_failures + 1;
+
+	agent_heartbeat_schedule (window);
 }
 
-static void
-got_agent_proxy_cb (GObject      *source_object,
-                    GAsyncResult *res,
-                    gpointer      data)
+static gboolean
+agent_heartbeat_send (gpointer data)
 {
-	GError *error = NULL;
-	GDBusProxy *proxy;
 	SysinfoWindow *window = SYSINFO_WINDOW (data);
 	SysinfoWindowPrivate *priv = window->priv;
 
-	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
-	if (proxy == NULL) {
-		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-			g_warning ("Error creating agent proxy: %s\n", error->message);
+	priv->agent_check_timeout_id = 0;
 
-		gtk_label_set_text (GTK_LABEL (priv->lbl_conn_status), _("Unknown"));
+	if (priv->agent_heartbeat_in_flight)
+		return FALSE;
 
-		g_error_free (error);
-		return;
-	}
+	priv->agent_heartbeat_in_flight = TRUE;
+
+	agent_do_task_async ("SERVER", "grm_heartbit", NULL,
+                         GOOROOM_AGENT_TASK_TIMEOUT,
+                         priv->cancellable,
+                         agent_heartbeat_done_cb, window);
 
-	const gchar *arg = "{\"module\":{\"module_name\":\"SERVER\",\"task\":{\"task_name\":\"grm_heartbit\",\"in\":{}}}}";
-
-	g_dbus_proxy_call (proxy,
-                       "do_task",
-                       g_variant_new ("(s)", arg),
-                       G_DBUS_CALL_FLAGS_NONE,
-                       -1,
-                       NULL,
-                       done_agent_proxy_cb,
-                       window);
-}
-
-
-static void
-agent_connection_status_check (gpointer data)
-{
-	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
-                              G_DBUS_CALL_FLAGS_NONE,
-                              NULL,
-                              "kr.gooroom.agent",
-                              "/kr/gooroom/agent",
-                              "kr.gooroom.agent",
-                              NULL,
-                              got_agent_proxy_cb,
-                              data);
-
-//	GDBusProxy *proxy;
-//	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-//			G_DBUS_CALL_FLAGS_NONE,
-//			NULL,
-//			"kr.gooroom.agent",
-//			"/kr/gooroom/agent",
-//			"kr.gooroom.agent",
-//			NULL,
-//			NULL);
-//
-//	if (!proxy) {
-//		gtk_label_set_text (GTK_LABEL (priv->lbl_conn_status), _("Unknown"));
-//		return;
-//	}
-//
-//	const gchar *arg = "{\"module\":{\"module_name\":\"SERVER\",\"task\":{\"task_name\":\"grm_heartbit\",\"in\":{}}}}";
-//
-//	g_dbus_proxy_call (proxy,
-//						"do_task",
-//						g_variant_new ("(s)", arg),
-//						G_DBUS_CALL_FLAGS_NONE,
-//						-1,
-//						NULL,
-//						done_agent_proxy_cb,
-//						data);
+	return FALSE;
 }
 
-static gboolean
-agent_connection_status_check_continually (gpointer data)
+static void
+agent_heartbeat_settings_changed_cb (GSettings *settings, const gchar *key, gpointer data)
 {
-	agent_connection_status_check (data);
-
-	return TRUE;
+	if (g_str_has_prefix (key, "heartbeat-"))
+		agent_heartbeat_schedule (SYSINFO_WINDOW (data));
 }
 
 static gboolean
-get_date (gchar *strdate, gint *yy, gint *mm, gint *dd)
+on_window_state_event (GtkWidget *widget, GdkEventWindowState *event, gpointer data)
 {
-	if (!strdate || sscanf (strdate, "%d-%d-%d", yy, mm, dd) == 0)
+	SysinfoWindow *window = SYSINFO_WINDOW (widget);
+	SysinfoWindowPrivate *priv = window->priv;
+	gboolean hidden;
+
+	hidden = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) != 0;
+	if (hidden == priv->hidden)
 		return FALSE;
 
-	return TRUE;
-}
+	priv->hidden = hidden;
 
-static gboolean
-get_time (gchar *strtime, gint *h, gint *m, gint *s)
-{
-	if (!strtime || sscanf (strtime, "%d:%d:%d", h, m, s) == 0)
-		return FALSE;
+	/* refresh right away when the user comes back, unless the agent is
+	 * known to be unreachable */
+	if (!hidden && priv->agent_heartbeat_failures == 0 && priv->agent_check_timeout_id != 0) {
+		/* the pending timer would send another one */
+		g_source_remove (priv->agent_check_timeout_id);
+		priv->agent_check_timeout_id = 0;
+		agent_heartbeat_send (window);
+	} else {
+		agent_heartbeat_schedule (window);
+	}
 
-	return TRUE;
+	return FALSE;
 }
 
 static void
-show_log (GtkWidget *treeview, json_object *root_obj, gint64 search_to_utime, GList *filters)
+security_log_entry_cb (const gchar *category, json_object *entry, gpointer data)
 {
-	g_return_if_fail (root_obj != NULL);
+	SecurityLogFetch *fetch = data;
 
-	GtkTreeIter iter;
-	GtkTreeModel *model;
-	model = gtk_tree_view_get_model (GTK_TREE_VIEW (treeview));
+	json_object *obj1_1 = JSON_OBJECT_GET (entry, "level");
+	json_object *obj1_2 = JSON_OBJECT_GET (entry, "log");
 
-	int i = 0, len = 0;
-	len = json_object_array_length (root_obj);
-	for (i = 0; i < len; i++) {
-		json_object *obj1 = json_object_array_get_idx (root_obj, i);
-		json_object *obj1_1 = JSON_OBJECT_GET (obj1, "level");
-		json_object *obj1_2 = JSON_OBJECT_GET (obj1, "log");
-
-		if (!obj1_1)
-			continue;
+	if (!obj1_1)
+		return;
 
-		const gchar *str_type = json_object_get_string (obj1_1);
+	/* every level is kept, the model filter decides what is shown */
+	gint level = security_log_level_from_string (json_object_get_string (obj1_1));
+	if (level < 0)
+		return;
 
-		if (!g_list_find_custom (filters, str_type, (GCompareFunc)g_strcmp0))
-			continue;
+	const char *str_log = (obj1_2) ? json_object_get_string (obj1_2) : NULL;
+	gint64 utime = security_log_time_parse (str_log, &fetch->day_cache);
 
-		guint j = 0;
-		gchar *display_type = NULL;
-		for (j = 0; LOG_DATA[j].type != NULL; j++) {
-			if (g_str_equal (str_type, LOG_DATA[j].type)) {
-				display_type = g_strdup (_(LOG_DATA[j].tr_type));
-				break;
-			}
-		}
-		if (!display_type)
-			display_type = g_strdup (_("Unknown"));
+	if (utime < fetch->keep_from || utime >= fetch->keep_to ||
+        (utime >= fetch->skip_from && utime < fetch->skip_to))
+		return;
 
-		gint64 utime;
-		gchar *date = NULL, *time = NULL, *desc = NULL;
+	security_log_model_append (fetch->window->priv->log_model, utime, level,
+                               security_log_category_from_key (category), str_log);
+}
 
-		if (obj1_2) {
-			const char *str_log = json_object_get_string (obj1_2);
+static SecurityLogFetch *
+security_log_fetch_new (SysinfoWindow *window, gint64 keep_from, gint64 keep_to)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+	SecurityLogFetch *fetch = g_new0 (SecurityLogFetch, 1);
 
-			gchar **lines = g_strsplit (str_log, " ", -1);
-			GDateTime *dt = NULL;
-			gint yy = 0, mm = 0, dd = 0, h = 0, m = 0, s = 0;
-			if (lines[0]) {
-				date = g_strdup (lines[0]);
-				get_date (date, &yy, &mm, &dd);
-			}
-			if (lines[1]) {
-				time = g_strdup (lines[1]);
-				get_time (time, &h, &m, &s);
-			}
-			dt = g_date_time_new_local (yy, mm, dd, h, m, s);
-			utime = g_date_time_to_unix (dt);
+	fetch->window = window;
+	fetch->cancellable = g_cancellable_new ();
+	fetch->first_entry = security_log_model_get_n_entries (priv->log_model);
+	fetch->keep_from = keep_from;
+	fetch->keep_to = keep_to;
 
-			if (lines[2] != NULL) {
-				GString *cnt = g_string_new (lines[2]);
+	if (priv->log_cache_from >= 0) {
+		fetch->skip_from = priv->log_cache_from;
+		fetch->skip_to = priv->log_cache_to;
+	}
 
-				guint j = 3;
-				while (lines[j] != NULL) {
-					g_string_append_printf (cnt, " %s", lines[j]);
-					j++;
-				}
+	return fetch;
+}
 
-				desc = g_strdup (cnt->str);
+static void
+security_log_fetch_free (SecurityLogFetch *fetch)
+{
+	g_object_unref (fetch->cancellable);
+	g_free (fetch);
+}
 
-				g_string_free (cnt, TRUE);
-			}
+/* Stops the running fetch and takes back the rows it already added.  The
+ * fetch itself is freed when the parser run reports it done. */
+static void
+security_log_fetch_cancel (SysinfoWindow *window)
+{
+	GdkWindow *gdk_window;
+	SysinfoWindowPrivate *priv = window->priv;
+	SecurityLogFetch *fetch = priv->log_fetch;
 
-			g_strfreev (lines);
+	if (!fetch)
+		return;
 
-			g_date_time_unref (dt);
-		}
+	priv->log_fetch = NULL;
 
-		if (utime <= search_to_utime) {
-			gtk_list_store_append (GTK_LIST_STORE (model), &iter);
-			gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-					0, date,
-					1, time,
-					2, display_type,
-					3, desc,
-					4, utime,
-					-1);
-		}
+	g_cancellable_cancel (fetch->cancellable);
+	security_log_model_truncate (priv->log_model, fetch->first_entry);
 
-		g_free (date);
-		g_free (time);
-		g_free (display_type);
-		g_free (desc);
-	}
+	gdk_window = gtk_widget_get_window (GTK_WIDGET (window));
+	if (gdk_window)
+		gdk_window_set_cursor (gdk_window, NULL);
 }
 
-static gboolean
-update_watch_output (GIOChannel   *source,
-                     GIOCondition  condition,
-                     gpointer      data)
+static void
+update_output_apply (SysinfoWindow *window, const gchar *outputs)
 {
-	gchar     buff[1024] = {0, };
-	gsize     bytes_read;
-
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
 	SysinfoWindowPrivate *priv = window->priv;
 
-	GString *outputs = g_string_new ("");
-
-	while (g_io_channel_read_chars (source, buff, sizeof (buff), &bytes_read, NULL) == G_IO_STATUS_NORMAL) {
-		outputs = g_string_append_len (outputs, buff, bytes_read);
-	}
-
 	gchar *pkgs = g_strdup ("-1");
 
-	if (outputs->str && outputs->len > 0) {
+	if (outputs && outputs[0] != '\0') {
 		guint i = 0;
-		gchar **lines = g_strsplit (outputs->str, "\n", -1);
+		gchar **lines = g_strsplit (outputs, "\n", -1);
 		for (i = 0; lines[i] != NULL; i++) {
 			if (g_str_has_prefix (lines[i], "packages=")) {
 				gchar **tokens = g_strsplit (lines[i], "=", -1);
 				if (tokens[1]) {
+					g_free (pkgs);
 					pkgs = g_strdup (tokens[1]);
 				}
 				g_strfreev (tokens);
@@ -793,8 +817,6 @@ update_watch_output (GIOChannel   *source,
 		g_strfreev (lines);
 	}
 
-	g_string_free (outputs, TRUE);
-
 	if (g_strcmp0 (pkgs, "-1") == 0) {
 		gtk_label_set_text (GTK_LABEL (priv->lbl_update), _("Unknown"));
 	} else if (g_strcmp0 (pkgs, "0") == 0) {
@@ -810,355 +832,445 @@ update_watch_output (GIOChannel   *source,
 		g_free (text);
 	}
 
-	return FALSE;
+	g_free (pkgs);
 }
 
-static int
-check_function_from_agent (SysinfoWindow *window, const gchar *task_name)
+static void
+update_check_done_cb (GObject *source, GAsyncResult *res, gpointer data)
 {
-	GDBusProxy *proxy = NULL;
+	gchar *outputs;
 
-	SysinfoWindowPrivate *priv = window->priv;
+	if (!command_output_get (res, &outputs))
+		return;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE,
-			NULL,
-			"kr.gooroom.agent",
-			"/kr/gooroom/agent",
-			"kr.gooroom.agent",
-			NULL,
-			NULL);
+	update_output_apply (SYSINFO_WINDOW (data), outputs);
+
+	g_free (outputs);
+}
+
+typedef void (*AgentFunctionFunc) (SysinfoWindow *window, gint state);
 
-	if (!proxy) return 0;
+typedef struct {
+	SysinfoWindow     *window;
+	AgentFunctionFunc  func;
+} AgentFunctionCheck;
 
+/* state is 1 if the agent reports the function enabled and -1 if it
+ * reports it disabled, answers with a D-Bus error or with data that can't
+ * be read.  It is 0, shown as unknown, if the agent could not be reached
+ * or did not answer in time. */
+static void
+check_function_from_agent_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
 	gint ret = -1;
-	gchar *result = NULL;
-	GVariant *variant = NULL;
-	gchar *arg = g_strdup_printf ("{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"%s\",\"in\":{}}}}", task_name);
-
-	variant = g_dbus_proxy_call_sync (proxy, "do_task",
-									g_variant_new ("(s)", arg),
-									G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
-
-	g_free (arg);
-
-	if (variant) {
-		GVariant *v = NULL;
-		g_variant_get (variant, "(v)", &v);
-		if (v) {
-			result = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
+	GError *error = NULL;
+	json_object *out_obj;
+	AgentFunctionCheck *check = data;
+
+	out_obj = agent_do_task_finish (res, &error);
+	if (!out_obj) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free (error);
+			g_free (check);
+			return;
 		}
-		g_variant_unref (variant);
-	}
 
-	if (result) {
-		enum json_tokener_error jerr = json_tokener_success;
-		json_object *root_obj = json_tokener_parse_verbose (result, &jerr);
-
-		if (jerr == json_tokener_success) {
-			json_object *obj1 = NULL, *obj2 = NULL, *obj3 = NULL, *obj4 = NULL, *obj5 = NULL;
-			obj1 = JSON_OBJECT_GET (root_obj, "module");
-			obj2 = JSON_OBJECT_GET (obj1, "task");
-			obj3 = JSON_OBJECT_GET (obj2, "out");
-			obj4 = JSON_OBJECT_GET (obj3, "operation");
-			obj5 = JSON_OBJECT_GET (obj3, "status");
-			if (obj5) {
-				const char *status = json_object_get_string (obj5);
-				if (status && g_strcmp0 (status, "200") == 0) {
-					const char *operation = json_object_get_string (obj4);
-					if (operation && g_strcmp0 (operation, "enable") == 0) {
-						ret = 1;
-					}
+		/* a D-Bus error reply or unreadable data counts as disabled,
+		 * any other I/O error, a timeout included, as unknown */
+		if (error->domain == G_IO_ERROR && error->code != G_IO_ERROR_INVALID_DATA)
+			ret = 0;
+		g_error_free (error);
+	} else {
+		json_object *obj1 = JSON_OBJECT_GET (out_obj, "operation");
+		json_object *obj2 = JSON_OBJECT_GET (out_obj, "status");
+		if (obj2) {
+			const char *status = json_object_get_string (obj2);
+			if (status && g_strcmp0 (status, "200") == 0) {
+				const char *operation = json_object_get_string (obj1);
+				if (operation && g_strcmp0 (operation, "enable") == 0) {
+					ret = 1;
 				}
 			}
-			json_object_put (root_obj);
 		}
 
-		g_free (result);
+		json_object_put (out_obj);
 	}
 
-	g_object_unref (proxy);
+	check->func (check->window, ret);
 
-	return ret;
+	g_free (check);
 }
 
-static gboolean
-iptables_policy_parse (GtkTreeView *treeview, const gchar *direction, const gchar *policy, gboolean ipv6)
+static void
+check_function_from_agent (SysinfoWindow *window, const gchar *task_name, AgentFunctionFunc func)
 {
-	g_return_val_if_fail (policy != NULL, FALSE);
+	AgentFunctionCheck *check = g_new0 (AgentFunctionCheck, 1);
 
-	gint argc;
-	gchar **argv;
-	gboolean ret = FALSE;
+	check->window = window;
+	check->func = func;
 
-	if (!g_shell_parse_argv (policy, &argc, &argv, NULL))
-		goto error;
+	agent_do_task_async ("config", task_name, NULL,
+                         GOOROOM_AGENT_TASK_TIMEOUT,
+                         window->priv->cancellable,
+                         check_function_from_agent_done_cb, check);
+}
 
-	if (argc < 4)
-		goto error;
+static void
+firewall_filter_apply (SysinfoWindow *window, gboolean ipv6)
+{
+	gboolean valid;
+	GtkStyleContext *context;
+	SysinfoWindowPrivate *priv = window->priv;
 
-	const gchar *status, *src, *dst, *prot;
+	GtkWidget *trv_firewall = ipv6 ? priv->trv_firewall6 : priv->trv_firewall4;
+	GtkWidget *cmb_chain = ipv6 ? priv->cmb_firewall6_chain : priv->cmb_firewall4_chain;
+	GtkWidget *cmb_target = ipv6 ? priv->cmb_firewall6_target : priv->cmb_firewall4_target;
+	GtkWidget *ent_search = ipv6 ? priv->ent_firewall6_search : priv->ent_firewall4_search;
+	FirewallRuleModel *model = ipv6 ? priv->firewall_model6 : priv->firewall_model4;
 
-	if (strstr (argv[0], "ACCEPT") != NULL) {
-		status = _("ACCEPT");
-	} else if (strstr (argv[0], "DROP") != NULL) {
-		status = _("DROP");
-	} else if (strstr (argv[0], "REJECT") != NULL) {
-		status = _("REJECT");
-	} else {
-		goto error;
-	}
+	/* a filter can touch every row; the view is faster rebuilt than told */
+	gtk_tree_view_set_model (GTK_TREE_VIEW (trv_firewall), NULL);
 
-	GtkTreeIter iter;
-	GtkTreeModel *model = gtk_tree_view_get_model (treeview);
-
-	/* ignore "opt" */
-	prot = argv[1];
-	src  = argv[3];
-	dst  = argv[4];
-	if (ipv6) {
-		src  = argv[2];
-		dst  = argv[3];
-	}
-
-	gtk_list_store_append (GTK_LIST_STORE (model), &iter);
-	gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-			0, status,
-			1, direction,
-			2, src,
-			3, dst,
-			4, prot,
-			-1);
+	valid = firewall_rule_model_set_filter (model,
+                                            gtk_combo_box_get_active_id (GTK_COMBO_BOX (cmb_chain)),
+                                            gtk_combo_box_get_active_id (GTK_COMBO_BOX (cmb_target)),
+                                            gtk_entry_get_text (GTK_ENTRY (ent_search)));
 
-	ret = TRUE;
+	gtk_tree_view_set_model (GTK_TREE_VIEW (trv_firewall), GTK_TREE_MODEL (model));
 
-error:
-	g_strfreev (argv);
+	context = gtk_widget_get_style_context (ent_search);
+	if (valid)
+		gtk_style_context_remove_class (context, GTK_STYLE_CLASS_ERROR);
+	else
+		gtk_style_context_add_class (context, GTK_STYLE_CLASS_ERROR);
+}
 
-	return ret;
+static void
+firewall_filter_changed_cb (GtkWidget *widget, gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	SysinfoWindowPrivate *priv = window->priv;
+
+	firewall_filter_apply (window, (widget == priv->cmb_firewall6_chain ||
+                                    widget == priv->cmb_firewall6_target ||
+                                    widget == priv->ent_firewall6_search));
 }
 
+/* Refills @combo with "all" and @names, keeping the selection if it
+ * still exists.  Returns TRUE if it does not and "all" was selected
+ * instead. */
 static gboolean
-iptables_output_parse (GIOChannel   *source,
-                       GIOCondition  condition,
-                       gpointer      data)
+firewall_filter_combo_fill (SysinfoWindow *window, GtkWidget *combo, const gchar *all, gchar **names)
 {
-	gchar  buff[1024] = {0, };
-	gsize  bytes_read;
-	gboolean visible = FALSE;
+	gint i;
+	gboolean lost = FALSE;
+	gchar *active = g_strdup (gtk_combo_box_get_active_id (GTK_COMBO_BOX (combo)));
 
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
-	SysinfoWindowPrivate *priv = window->priv;
+	g_signal_handlers_block_by_func (combo, firewall_filter_changed_cb, window);
 
-	GString *outputs = g_string_new ("");
+	gtk_combo_box_text_remove_all (GTK_COMBO_BOX_TEXT (combo));
+	gtk_combo_box_text_append (GTK_COMBO_BOX_TEXT (combo), "", all);
+	for (i = 0; names[i] != NULL; i++)
+		gtk_combo_box_text_append (GTK_COMBO_BOX_TEXT (combo), names[i], names[i]);
 
-	while (g_io_channel_read_chars (source, buff, sizeof (buff), &bytes_read, NULL) == G_IO_STATUS_NORMAL) {
-		outputs = g_string_append_len (outputs, buff, bytes_read);
+	if (!active || !gtk_combo_box_set_active_id (GTK_COMBO_BOX (combo), active)) {
+		gtk_combo_box_set_active_id (GTK_COMBO_BOX (combo), "");
+		lost = (active && *active);
 	}
 
-	if (outputs->str && outputs->len > 0) {
-		gint i = 0;
-		gchar **lines = g_strsplit (outputs->str, "\n", -1);
-		gboolean input = FALSE, output = FALSE, forward = FALSE;
-		for (i = 0; lines[i] != NULL; i++) {
-			if (strstr (lines[i], "Chain INPUT") != NULL) {
-				input = TRUE; output = FALSE; forward = FALSE;
-
-				gchar *markup;
-				if (strstr (lines[i], "(policy ACCEPT)") != NULL) {
-					markup = g_markup_printf_escaped ("<i><span foreground=\"#0000ff\">(%s)</span></i>", _("Accept"));
-				} else if (strstr (lines[i], "(policy DROP)") != NULL) {
-					markup = g_markup_printf_escaped ("<i><span foreground=\"#0000ff\">(%s)</span></i>", _("Drop"));
-				} else {
-					markup = g_markup_printf_escaped ("<i>""</i>");
-				}
-				if (priv->setting_ipv4) {
-					gtk_label_set_markup (GTK_LABEL (priv->lbl_firewall4_policy), markup);
-				} else {
-					gtk_label_set_markup (GTK_LABEL (priv->lbl_firewall6_policy), markup);
-				}
-				g_free (markup);
+	g_signal_handlers_unblock_by_func (combo, firewall_filter_changed_cb, window);
 
-				++i; // skip next line;
+	g_free (active);
 
-				continue;
-			}
+	return lost;
+}
 
-			if (strstr (lines[i], "Chain OUTPUT") != NULL) {
-				input = FALSE; output = TRUE; forward = FALSE;
-				++i; // skip next line;
-				continue;
-			}
+/* @dump is the output of iptables-save or ip6tables-save. */
+static void
+iptables_output_apply (SysinfoWindow *window, gboolean ipv6, GBytes *dump)
+{
+	gchar *markup;
+	gchar **names;
+	gboolean first, lost;
+	const FirewallChain *input;
+	FirewallRuleset *ruleset;
+	SysinfoWindowPrivate *priv = window->priv;
 
-			if (strstr (lines[i], "Chain FORWARD") != NULL) {
-				input = FALSE; output = FALSE; forward = TRUE;
-				++i; // skip next line;
-				continue;
-			}
+	GtkWidget *trv_firewall = ipv6 ? priv->trv_firewall6 : priv->trv_firewall4;
+	GtkWidget *scl_firewall = ipv6 ? priv->scl_firewall6 : priv->scl_firewall4;
+	GtkWidget *lbl_firewall = ipv6 ? priv->lbl_firewall6 : priv->lbl_firewall4;
+	GtkWidget *lbl_firewall_policy = ipv6 ? priv->lbl_firewall6_policy : priv->lbl_firewall4_policy;
+	GtkWidget *box_filter = ipv6 ? priv->box_firewall6_filter : priv->box_firewall4_filter;
+	GtkWidget *cmb_chain = ipv6 ? priv->cmb_firewall6_chain : priv->cmb_firewall4_chain;
+	GtkWidget *cmb_target = ipv6 ? priv->cmb_firewall6_target : priv->cmb_firewall4_target;
+	FirewallRuleModel *model = ipv6 ? priv->firewall_model6 : priv->firewall_model4;
+
+	ruleset = firewall_ruleset_parse (dump);
+
+	input = firewall_ruleset_find_chain (ruleset, "filter", "INPUT");
+	if (input && firewall_slice_equal (&input->policy, "ACCEPT")) {
+		markup = g_markup_printf_escaped ("<i><span foreground=\"#0000ff\">(%s)</span></i>", _("Accept"));
+	} else if (input && firewall_slice_equal (&input->policy, "DROP")) {
+		markup = g_markup_printf_escaped ("<i><span foreground=\"#0000ff\">(%s)</span></i>", _("Drop"));
+	} else {
+		markup = g_markup_printf_escaped ("<i>""</i>");
+	}
+	gtk_label_set_markup (GTK_LABEL (lbl_firewall_policy), markup);
+	g_free (markup);
 
-			if (g_str_has_prefix (lines[i], "ACCEPT") ||
-                g_str_has_prefix (lines[i], "DROP")   ||
-                g_str_has_prefix (lines[i], "REJECT"))
-			{
-				if (input || output || forward) {
-					const gchar *direction;
-
-					if (input) direction = _("INPUT");
-					else if (output) direction =  _("OUTPUT");
-					else if (forward) direction =  _("FORWARD");
-					else continue;
-
-					if (priv->setting_ipv4) {
-						visible = iptables_policy_parse (GTK_TREE_VIEW (priv->trv_firewall4), direction, lines[i], FALSE);
-					} else {
-						visible = iptables_policy_parse (GTK_TREE_VIEW (priv->trv_firewall6), direction, lines[i], TRUE);
-					}
-				}
-			}
-		}
+	/* a first fill is faster with the view detached; a refresh is told
+	 * to the view row by row so it keeps its selection and scroll
+	 * position.  The model owns the ruleset from here on. */
+	first = (firewall_rule_model_get_n_rules (model) == 0);
+	if (first)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (trv_firewall), NULL);
 
-		g_strfreev (lines);
-	}
+	firewall_rule_model_set_ruleset (model, ruleset);
 
-	g_string_free (outputs, TRUE);
+	if (first)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (trv_firewall), GTK_TREE_MODEL (model));
 
-	if (visible) {
-		if (priv->setting_ipv4) {
-			gtk_widget_show (priv->scl_firewall4);
-			gtk_widget_hide (priv->lbl_firewall4);
-		} else {
-			gtk_widget_show (priv->scl_firewall6);
-			gtk_widget_hide (priv->lbl_firewall6);
-		}
+	names = firewall_rule_model_list_chains (model);
+	lost = firewall_filter_combo_fill (window, cmb_chain, _("All chains"), names);
+	g_strfreev (names);
+
+	names = firewall_rule_model_list_targets (model);
+	lost |= firewall_filter_combo_fill (window, cmb_target, _("All statuses"), names);
+	g_strfreev (names);
+
+	/* the model still filters on what is gone */
+	if (lost)
+		firewall_filter_apply (window, ipv6);
+
+	if (firewall_rule_model_get_n_rules (model) > 0) {
+		gtk_widget_show (box_filter);
+		gtk_widget_show (scl_firewall);
+		gtk_widget_hide (lbl_firewall);
 	} else {
-		gchar *markup = g_markup_printf_escaped ("<i>%s</i>", _("Could not find firewall policy."));
+		markup = g_markup_printf_escaped ("<i>%s</i>", _("Could not find firewall policy."));
 
-		if (priv->setting_ipv4) {
-			gtk_widget_show (priv->lbl_firewall4);
-			gtk_widget_hide (priv->scl_firewall4);
-			gtk_label_set_markup (GTK_LABEL (priv->lbl_firewall4), markup);
-		} else {
-			gtk_widget_show (priv->lbl_firewall6);
-			gtk_widget_hide (priv->scl_firewall6);
-			gtk_label_set_markup (GTK_LABEL (priv->lbl_firewall6), markup);
-		}
+		gtk_widget_show (lbl_firewall);
+		gtk_widget_hide (box_filter);
+		gtk_widget_hide (scl_firewall);
+		gtk_label_set_markup (GTK_LABEL (lbl_firewall), markup);
 
 		g_free (markup);
 	}
-
-	return FALSE;
 }
 
+/* One per address family, so the v4 and v6 dumps run side by side. */
+typedef struct {
+	SysinfoWindow *window;
+	GCancellable  *cancellable;
+	gboolean       ipv6;
+} FirewallCollect;
 
 static void
-run_iptables_command (const char *command, SysinfoWindow *window)
+firewall_collect_free (FirewallCollect *collect)
 {
-	GPid pid;
-	gint stdout_fd;
-	gchar **arr_cmd;
-	gchar *pkexec, *cmdline = NULL;
+	g_object_unref (collect->cancellable);
+	g_free (collect);
+}
 
-	SysinfoWindowPrivate *priv = window->priv;
+static void
+firewall_collect_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GBytes *dump;
+	GError *error = NULL;
+	FirewallCollect *collect = data;
 
-	if (g_str_equal (command, GOOROOM_IPTABLES_WRAPPER)) {
-		priv->setting_ipv4 = TRUE;
-	} else if (g_str_equal (command, GOOROOM_IP6TABLES_WRAPPER)) {
-		priv->setting_ipv4 = FALSE;
-	} else {
-		goto done;
+	dump = command_runner_finish (res, NULL, &error);
+	if (dump) {
+		iptables_output_apply (collect->window, collect->ipv6, dump);
+		g_bytes_unref (dump);
+	} else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		iptables_output_apply (collect->window, collect->ipv6, NULL);
 	}
 
-	pkexec = g_find_program_in_path ("pkexec");
-	cmdline = g_strdup_printf ("%s %s", pkexec, command);
-
-	arr_cmd = g_strsplit (cmdline, " ", -1);
-
-	if (g_spawn_async_with_pipes (NULL,
-                                  arr_cmd,
-                                  NULL,
-                                  G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                  NULL,
-                                  NULL,
-                                  &pid,
-                                  NULL,
-                                  &stdout_fd,
-                                  NULL,
-                                  NULL))
-	{
-		priv->iptable_cmd_lock = TRUE;
+	g_clear_error (&error);
+	firewall_collect_free (collect);
+}
 
-		g_child_watch_add (pid, (GChildWatchFunc)iptables_command_done_cb, window);
+/* Reads the rules from @stdout_fd if the helper gave one, otherwise
+ * runs the wrapper through pkexec. */
+static void
+firewall_collect_run (FirewallCollect *collect, gint stdout_fd)
+{
+	CommandRunnerOptions options = { 0, };
 
-		GIOChannel *io_channel = g_io_channel_unix_new (stdout_fd);
-		g_io_channel_set_flags (io_channel, G_IO_FLAG_NONBLOCK, NULL);
-		g_io_channel_set_encoding (io_channel, NULL, NULL);
-		g_io_channel_set_buffered (io_channel, FALSE);
-		g_io_channel_set_close_on_unref (io_channel, TRUE);
-		g_io_add_watch (io_channel, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP, iptables_output_parse, window);
-		g_io_channel_unref (io_channel);
-	}
-	else
-	{
-		goto done;
+	options.timeout = COMMAND_TIMEOUT;
+	options.keep_output = TRUE;
+
+	if (stdout_fd >= 0) {
+		command_runner_read_fd_async (stdout_fd, &options, collect->cancellable,
+                                      firewall_collect_done_cb, collect);
+	} else {
+		const gchar *argv[] = { "pkexec",
+                                collect->ipv6 ? GOOROOM_IP6TABLES_WRAPPER : GOOROOM_IPTABLES_WRAPPER,
+                                NULL };
+		command_runner_spawn_async (argv, &options, collect->cancellable,
+                                    firewall_collect_done_cb, collect);
 	}
+}
 
-	g_free (pkexec);
-	g_free (cmdline);
+static void
+firewall_collect_helper_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	gint stdout_fd = -1;
+	GVariant *reply;
+	GError *error = NULL;
+	FirewallCollect *collect = data;
 
-	g_strfreev (arr_cmd);
+	reply = security_status_helper_call_finish (res, &stdout_fd, &error);
+	if (!reply && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		firewall_collect_free (collect);
+		return;
+	}
 
-	return;
+	if (reply)
+		g_variant_unref (reply);
+	g_clear_error (&error);
 
-done:
-	priv->iptable_cmd_lock = FALSE;
+	firewall_collect_run (collect, stdout_fd);
 }
 
 static void
-system_firewall_check (SysinfoWindow *window)
+firewall_collect (SysinfoWindow *window, gboolean ipv6)
 {
-	window->priv->iptable_cmd_lock = FALSE;
+	FirewallCollect *collect;
+	GBytes *probed = NULL;
+	SysinfoWindowPrivate *priv = window->priv;
+
+	if (priv->probe)
+		probed = g_hash_table_lookup (priv->probe, ipv6 ? "ip6tables" : "iptables");
 
-	run_iptables_command (GOOROOM_IPTABLES_WRAPPER, window);
+	if (probed) {
+		iptables_output_apply (window, ipv6, probed);
+		return;
+	}
 
-	while (window->priv->iptable_cmd_lock)
-		gtk_main_iteration ();
+	collect = g_new0 (FirewallCollect, 1);
+	collect->window = window;
+	collect->cancellable = g_object_ref (priv->cancellable);
+	collect->ipv6 = ipv6;
 
-	run_iptables_command (GOOROOM_IP6TABLES_WRAPPER, window);
+	if (!security_status_helper_call ("ListFirewallRules", g_variant_new ("(b)", ipv6),
+                                      -1, collect->cancellable,
+                                      firewall_collect_helper_cb, collect))
+		firewall_collect_run (collect, -1);
 }
 
 static void
-package_updating_check (gpointer data)
+firewall_fingerprint_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	gchar **known;
+	GVariant *reply;
+	const gchar *fingerprint;
+	FirewallCollect *collect = data;
+	SysinfoWindowPrivate *priv;
+
+	/* also NULL when the window is gone */
+	reply = security_status_helper_call_finish (res, NULL, NULL);
+	if (!reply)
+		goto out;
+
+	priv = collect->window->priv;
+	known = collect->ipv6 ? &priv->firewall_fingerprint6 : &priv->firewall_fingerprint4;
+
+	g_variant_get (reply, "(&s)", &fingerprint);
+
+	/* the first one comes along with the initial dump */
+	if (g_strcmp0 (*known, fingerprint) != 0) {
+		gboolean changed = (*known != NULL);
+
+		g_free (*known);
+		*known = g_strdup (fingerprint);
+
+		if (changed)
+			firewall_collect (collect->window, collect->ipv6);
+	}
+
+out:
+	if (reply)
+		g_variant_unref (reply);
+	firewall_collect_free (collect);
+}
+
+/* Asks the helper for a hash of the rules, which is far cheaper than
+ * reading and showing them, and reads them again if it changed.
+ * Returns FALSE if there is no helper to ask. */
+static gboolean
+firewall_fingerprint_check (SysinfoWindow *window, gboolean ipv6)
+{
+	FirewallCollect *collect;
+
+	collect = g_new0 (FirewallCollect, 1);
+	collect->window = window;
+	collect->cancellable = g_object_ref (window->priv->cancellable);
+	collect->ipv6 = ipv6;
+
+	if (!security_status_helper_call ("GetFirewallFingerprint", g_variant_new ("(b)", ipv6),
+                                      -1, collect->cancellable,
+                                      firewall_fingerprint_cb, collect)) {
+		firewall_collect_free (collect);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Each poll restarts the helper's idle timeout (HELPER_IDLE_TIMEOUT), so
+ * the helper stays resident while the window is shown.  Polls are skipped
+ * while it is hidden, which lets the helper exit then. */
+static gboolean
+firewall_check_continually (gpointer data)
 {
 	SysinfoWindow *window = SYSINFO_WINDOW (data);
 	SysinfoWindowPrivate *priv = window->priv;
 
-	GPid pid;
-	gint stdout_fd;
-	gchar *arr_cmd[] = { GOOROOM_UPDATE_CHECKER, NULL };
+	if (priv->hidden)
+		return TRUE;
 
-	if (g_spawn_async_with_pipes (NULL,
-                                  arr_cmd,
-                                  NULL,
-                                  G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                  NULL,
-                                  NULL,
-                                  &pid,
-                                  NULL,
-                                  &stdout_fd,
-                                  NULL,
-                                  NULL)) {
+	if (!firewall_fingerprint_check (window, FALSE) ||
+        !firewall_fingerprint_check (window, TRUE)) {
+		priv->firewall_check_timeout_id = 0;
+		return FALSE;
+	}
 
-		g_child_watch_add (pid, (GChildWatchFunc)g_spawn_async_done_cb, NULL);
+	return TRUE;
+}
 
-		GIOChannel *io_channel = g_io_channel_unix_new (stdout_fd);
-		g_io_channel_set_flags (io_channel, G_IO_FLAG_NONBLOCK, NULL);
-		g_io_channel_set_encoding (io_channel, NULL, NULL);
-		g_io_channel_set_buffered (io_channel, FALSE);
-		g_io_channel_set_close_on_unref (io_channel, TRUE);
-		g_io_add_watch (io_channel, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP, (GIOFunc) update_watch_output, window);
-		g_io_channel_unref (io_channel);
+static void
+system_firewall_check (SysinfoWindow *window)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+
+	/* asked before the dumps, so a change in between is caught later */
+	if (firewall_fingerprint_check (window, FALSE) &&
+        firewall_fingerprint_check (window, TRUE) &&
+        priv->firewall_check_timeout_id == 0) {
+		priv->firewall_check_timeout_id = g_timeout_add_seconds (FIREWALL_CHECK_INTERVAL,
+                                                                 firewall_check_continually,
+                                                                 window);
 	}
+
+	firewall_collect (window, FALSE);
+	firewall_collect (window, TRUE);
+}
+
+static void
+package_updating_check (gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	const gchar *argv[] = { GOOROOM_UPDATE_CHECKER, NULL };
+	CommandRunnerOptions options = { 0, };
+
+	options.timeout = COMMAND_TIMEOUT;
+	options.keep_output = TRUE;
+
+	command_runner_spawn_async (argv, &options, window->priv->cancellable,
+                                update_check_done_cb, window);
 }
 
 static gboolean
@@ -1169,6 +1281,81 @@ package_updating_check_continually (gpointer data)
 	return TRUE;
 }
 
+static gboolean
+package_updating_check_debounced (gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+
+	window->priv->update_check_debounce_id = 0;
+
+	package_updating_check (window);
+
+	return FALSE;
+}
+
+static void
+package_files_changed_cb (GFileMonitor      *monitor,
+                          GFile             *file,
+                          GFile             *other_file,
+                          GFileMonitorEvent  event_type,
+                          gpointer           data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	SysinfoWindowPrivate *priv = window->priv;
+
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_DELETED:
+		case G_FILE_MONITOR_EVENT_CREATED:
+		case G_FILE_MONITOR_EVENT_MOVED_IN:
+		case G_FILE_MONITOR_EVENT_MOVED_OUT:
+		case G_FILE_MONITOR_EVENT_RENAMED:
+			break;
+
+		default:
+			return;
+	}
+
+	/* dpkg and apt-get update touch many files in a row, so wait until
+	 * they have been quiet for a while before counting again */
+	if (priv->update_check_debounce_id != 0)
+		g_source_remove (priv->update_check_debounce_id);
+
+	priv->update_check_debounce_id = g_timeout_add_seconds (UPDATE_PACKAGES_CHECK_DEBOUNCE,
+                                                            package_updating_check_debounced,
+                                                            window);
+}
+
+static void
+package_updating_watch (SysinfoWindow *window)
+{
+	GFile *file;
+	GFileMonitor *monitor;
+	SysinfoWindowPrivate *priv = window->priv;
+
+	file = g_file_new_for_path (DPKG_STATUS_FILE);
+	monitor = g_file_monitor_file (file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+	if (monitor) {
+		g_signal_connect (monitor, "changed", G_CALLBACK (package_files_changed_cb), window);
+		priv->update_monitors = g_list_prepend (priv->update_monitors, monitor);
+	}
+	g_object_unref (file);
+
+	file = g_file_new_for_path (APT_LISTS_DIR);
+	monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+	if (monitor) {
+		g_signal_connect (monitor, "changed", G_CALLBACK (package_files_changed_cb), window);
+		priv->update_monitors = g_list_prepend (priv->update_monitors, monitor);
+	}
+	g_object_unref (file);
+
+	/* the monitors can miss changes, e.g. on a network mount */
+	priv->update_check_timeout_id = g_timeout_add_seconds (UPDATE_PACKAGES_CHECK_TIMEOUT,
+                                                           package_updating_check_continually,
+                                                           window);
+}
+
 static guint
 get_loglevel_from_string (const char *strloglevel)
 {
@@ -1306,20 +1493,40 @@ system_security_status_update (SysinfoWindow *window)
 }
 
 static guint
-last_vulnerable_get (void)
+last_vulnerable_parse (const gchar *str_vulnerable)
+{
+	guint vulnerable = 0;
+
+	if (str_vulnerable && 1 == sscanf (str_vulnerable, "%"G_GUINT32_FORMAT, &vulnerable)) {
+		if ((vulnerable < (1 << 0)) ||
+            (vulnerable >= (1 << 4))) { // 1 <= vulnerable < 16
+			vulnerable = 0;
+		}
+	} else {
+		vulnerable = 0;
+	}
+
+	return vulnerable;
+}
+
+static guint
+last_vulnerable_get (SysinfoWindow *window)
 {
 	guint vulnerable = 0;
 	gchar *str_vulnerable = NULL;
+	SysinfoWindowPrivate *priv = window->priv;
+
+	/* the startup probe already read it */
+	if (priv->probe_vulnerable >= 0) {
+		vulnerable = priv->probe_vulnerable;
+		priv->probe_vulnerable = -1;
+		return vulnerable;
+	}
 
 	if (g_file_test (GOOROOM_SECURITY_STATUS_VULNERABLE, G_FILE_TEST_EXISTS)) {
 		g_file_get_contents (GOOROOM_SECURITY_STATUS_VULNERABLE, &str_vulnerable, NULL, NULL);
 
-		if (1 == sscanf (str_vulnerable, "%"G_GUINT32_FORMAT, &vulnerable)) {
-			if ((vulnerable < (1 << 0)) ||
-                (vulnerable >= (1 << 4))) { // 1 <= vulnerable < 16
-				vulnerable = 0;
-			}
-		}
+		vulnerable = last_vulnerable_parse (str_vulnerable);
 	}
 
 	g_free (str_vulnerable);
@@ -1327,24 +1534,94 @@ last_vulnerable_get (void)
 	return vulnerable;
 }
 
-static gboolean
-security_logparser_async_done (GIOChannel   *source,
-                               GIOCondition  condition,
-                               gpointer      data)
+static void
+security_status_start_cb (const gchar *seektime, gpointer data)
 {
-	gchar buff[1024] = {0, };
-	gsize bytes_read;
-	guint last_vulnerable = 0;
+	SecurityStatusFetch *fetch = data;
 
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	fetch->recount = (g_strcmp0 (seektime, fetch->seektime) != 0);
+	fetch->seek_utime = seek_time_to_utime (fetch->seektime);
+}
+
+static void
+security_status_entry_cb (const gchar *category, json_object *entry, gpointer data)
+{
+	gint level, category_id;
+	const gchar *str_log;
+	SecurityStatusFetch *fetch = data;
+
+	if (!fetch->recount)
+		return;
+
+	category_id = security_log_category_from_key (category);
+	if (category_id >= SECURITY_LOG_CATEGORY_AGENT)
+		return;
+
+	level = security_log_level_from_string (json_object_get_string (JSON_OBJECT_GET (entry, "level")));
+	if (level < 0)
+		return;
+
+	str_log = json_object_get_string (JSON_OBJECT_GET (entry, "log"));
+	if (security_log_time_parse (str_log, &fetch->day_cache) < fetch->seek_utime)
+		return;
+
+	fetch->levels[category_id] |= (1 << level);
+}
+
+static void
+security_status_member_cb (const gchar *key, json_object *value, gpointer data)
+{
+	SecurityStatusFetch *fetch = data;
+
+	json_object_object_add (fetch->members, key, json_object_get (value));
+}
+
+/* A category is vulnerable when a level it notifies of was logged since
+ * the seektime while its protection runs. */
+static guint
+security_status_recount (SecurityStatusFetch *fetch)
+{
+	gint i;
+	SysinfoWindowPrivate *priv = fetch->window->priv;
+	guint notify_levels[SECURITY_LOG_CATEGORY_AGENT];
+
+	notify_levels[SECURITY_LOG_CATEGORY_OS] = priv->os_notify_level;
+	notify_levels[SECURITY_LOG_CATEGORY_EXE] = priv->exe_notify_level;
+	notify_levels[SECURITY_LOG_CATEGORY_BOOT] = priv->boot_notify_level;
+	notify_levels[SECURITY_LOG_CATEGORY_MEDIA] = priv->media_notify_level;
+
+	for (i = 0; i < SECURITY_LOG_CATEGORY_AGENT; i++) {
+		if ((priv->security_item_run & (1 << i)) && (fetch->levels[i] & notify_levels[i]))
+			return SECURITY_STATUS_VULNERABLE;
+	}
+
+	return SECURITY_STATUS_SAFETY;
+}
+
+static void
+security_status_show (SysinfoWindow *window)
+{
+	guint last_vulnerable;
 	SysinfoWindowPrivate *priv = window->priv;
 
-	GString *outputs = g_string_new ("");
+	last_vulnerable = last_vulnerable_get (window);
 
-	while (g_io_channel_read_chars (source, buff, sizeof (buff), &bytes_read, NULL) == G_IO_STATUS_NORMAL)
-		outputs = g_string_append_len (outputs, buff, bytes_read);
+	if (last_vulnerable != 0)
+		priv->security_status = SECURITY_STATUS_VULNERABLE;
 
-	if (!outputs->str || outputs->len <= 0) {
+	system_security_status_update (window);
+	system_security_function_update (window);
+}
+
+static void
+security_logparser_async_done (gboolean complete, gpointer data)
+{
+	SecurityStatusFetch *fetch = data;
+	SysinfoWindow *window = fetch->window;
+	SysinfoWindowPrivate *priv = window->priv;
+	json_object *root_obj = fetch->members;
+
+	if (json_object_object_length (root_obj) == 0) {
 		priv->security_status = SECURITY_STATUS_UNKNOWN;
 		priv->security_item_run = 0;
 		priv->os_notify_level = 0;
@@ -1354,84 +1631,237 @@ security_logparser_async_done (GIOChannel   *source,
 		goto done;
 	}
 
-	gchar *json_output = strstr (outputs->str, "JSON-ANCHOR=");
-	if (json_output) {
-		gchar *json_string = json_output + strlen ("JSON-ANCHOR=");
-		enum json_tokener_error jerr = json_tokener_success;
-		json_object *root_obj = json_tokener_parse_verbose (json_string, &jerr);
-		if (jerr == json_tokener_success) {
-			json_object *summary_obj;
-			json_object *os_run_obj, *exe_run_obj, *boot_run_obj, *media_run_obj;
-			json_object *os_notify_level_obj, *exe_notify_level_obj, *boot_notify_level_obj, *media_notify_level_obj;
-
-			summary_obj = JSON_OBJECT_GET (root_obj, "status_summary");
-			os_run_obj = JSON_OBJECT_GET (root_obj, "os_run");
-			exe_run_obj = JSON_OBJECT_GET (root_obj, "exe_run");
-			boot_run_obj = JSON_OBJECT_GET (root_obj, "boot_run");
-			media_run_obj = JSON_OBJECT_GET (root_obj, "media_run");
-			os_notify_level_obj = JSON_OBJECT_GET (root_obj, "os_notify_level");
-			exe_notify_level_obj = JSON_OBJECT_GET (root_obj, "exe_notify_level");
-			boot_notify_level_obj = JSON_OBJECT_GET (root_obj, "boot_notify_level");
-			media_notify_level_obj = JSON_OBJECT_GET (root_obj, "media_notify_level");
-
-			if (summary_obj) {
-				const char *val = json_object_get_string (summary_obj);
-				if (val) {
-					if (g_str_equal (val, "safe")) {
-						priv->security_status = SECURITY_STATUS_SAFETY;
-					} else if (g_str_equal (val, "vulnerable")) {
-						priv->security_status = SECURITY_STATUS_VULNERABLE;
-					} else {
-						priv->security_status = SECURITY_STATUS_UNKNOWN;
-					}
-				}
-			}
-
-			priv->security_item_run = security_item_run_get (os_run_obj, exe_run_obj, boot_run_obj, media_run_obj);
+	json_object *summary_obj;
+	json_object *os_run_obj, *exe_run_obj, *boot_run_obj, *media_run_obj;
+	json_object *os_notify_level_obj, *exe_notify_level_obj, *boot_notify_level_obj, *media_notify_level_obj;
 
-			priv->os_notify_level = log_level_get (os_notify_level_obj);
-			priv->exe_notify_level = log_level_get (exe_notify_level_obj);
-			priv->boot_notify_level = log_level_get (boot_notify_level_obj);
-			priv->media_notify_level = log_level_get (media_notify_level_obj);
+	summary_obj = JSON_OBJECT_GET (root_obj, "status_summary");
+	os_run_obj = JSON_OBJECT_GET (root_obj, "os_run");
+	exe_run_obj = JSON_OBJECT_GET (root_obj, "exe_run");
+	boot_run_obj = JSON_OBJECT_GET (root_obj, "boot_run");
+	media_run_obj = JSON_OBJECT_GET (root_obj, "media_run");
+	os_notify_level_obj = JSON_OBJECT_GET (root_obj, "os_notify_level");
+	exe_notify_level_obj = JSON_OBJECT_GET (root_obj, "exe_notify_level");
+	boot_notify_level_obj = JSON_OBJECT_GET (root_obj, "boot_notify_level");
+	media_notify_level_obj = JSON_OBJECT_GET (root_obj, "media_notify_level");
 
-			json_object_put (root_obj);
+	if (summary_obj) {
+		const char *val = json_object_get_string (summary_obj);
+		if (val) {
+			if (g_str_equal (val, "safe")) {
+				priv->security_status = SECURITY_STATUS_SAFETY;
+			} else if (g_str_equal (val, "vulnerable")) {
+				priv->security_status = SECURITY_STATUS_VULNERABLE;
+			} else {
+				priv->security_status = SECURITY_STATUS_UNKNOWN;
+			}
 		}
 	}
 
+	priv->security_item_run = security_item_run_get (os_run_obj, exe_run_obj, boot_run_obj, media_run_obj);
+
+	priv->os_notify_level = log_level_get (os_notify_level_obj);
+	priv->exe_notify_level = log_level_get (exe_notify_level_obj);
+	priv->boot_notify_level = log_level_get (boot_notify_level_obj);
+	priv->media_notify_level = log_level_get (media_notify_level_obj);
+
+	/* the summary is that of an earlier seektime */
+	if (fetch->recount)
+		priv->security_status = security_status_recount (fetch);
 
 done:
-	last_vulnerable = last_vulnerable_get ();
+	json_object_put (fetch->members);
+	g_free (fetch->seektime);
+	g_free (fetch);
 
-    if (last_vulnerable != 0)
-		priv->security_status = SECURITY_STATUS_VULNERABLE;
+	/* the vulnerable flag comes with the privileged probe */
+	if (priv->probe_running) {
+		priv->status_waiting = TRUE;
+		return;
+	}
 
-	system_security_status_update (window);
-	system_security_function_update (window);
+	security_status_show (window);
+}
+
+static const SecurityLogParserFuncs security_status_parser_funcs = {
+	security_status_entry_cb,
+	security_status_member_cb,
+	NULL,
+	security_logparser_async_done,
+	security_status_start_cb
+};
+
+static gboolean
+security_status_update_idle (gpointer data)
+{
+	gchar *seektime = NULL;
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	SysinfoWindowPrivate *priv = window->priv;
+
+	g_file_get_contents (GOOROOM_SECURITY_LOGPARSER_NEXT_SEEKTIME, &seektime, NULL, NULL);
 
-	g_string_free (outputs, TRUE);
+	/* the parser run goes by the stripped seektime */
+	if (seektime && *g_strstrip (seektime) == '\0')
+		g_clear_pointer (&seektime, g_free);
+
+	SecurityStatusFetch *fetch = g_new0 (SecurityStatusFetch, 1);
+	fetch->window = window;
+	fetch->members = json_object_new_object ();
+	fetch->seektime = seektime;
+
+	if (!run_security_log_parser_async (seektime, &security_status_parser_funcs, NULL, fetch)) {
+		json_object_put (fetch->members);
+		g_free (fetch->seektime);
+		g_free (fetch);
+
+		if (gtk_widget_get_visible (priv->btn_safety_measure))
+			gtk_widget_set_sensitive (priv->btn_safety_measure, FALSE);
+
+		gchar *markup = g_markup_printf_escaped ("<b><i>%s</i></b>", _("Unknown"));
+		gtk_label_set_markup (GTK_LABEL (priv->lbl_sec_status), markup);
+		g_free (markup);
+	}
 
 	return FALSE;
 }
 
-static gboolean
-security_status_update_idle (gpointer data)
-{
-	gchar *seektime = NULL;
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
-	SysinfoWindowPrivate *priv = window->priv;
+/* Splits the document written by GOOROOM_SECURITY_STATUS_PROBE:
+ * a "GOOROOM-PROBE 1" line followed by "<name> <length>\n<data>\n"
+ * sections.  Returns name -> NUL-terminated GBytes, or NULL. */
+static GHashTable *
+privileged_probe_parse (const gchar *data, gsize len)
+{
+	const gchar *p, *end = data + len;
+	const gchar *header = "GOOROOM-PROBE 1\n";
+	GHashTable *sections;
+
+	if (len < strlen (header) || strncmp (data, header, strlen (header)) != 0)
+		return NULL;
+
+	sections = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      g_free, (GDestroyNotify) g_bytes_unref);
+
+	p = data + strlen (header);
+	while (p < end) {
+		gchar *line, *space, *endptr;
+		guint64 size;
+		const gchar *nl = memchr (p, '\n', end - p);
+
+		if (!nl)
+			break;
+
+		line = g_strndup (p, nl - p);
+		space = strchr (line, ' ');
+		if (!space) {
+			g_free (line);
+			break;
+		}
+
+		*space = '\0';
+		size = g_ascii_strtoull (space + 1, &endptr, 10);
+		if (*endptr != '\0' || size > (guint64)(end - nl - 1)) {
+			g_free (line);
+			break;
+		}
+
+		g_hash_table_replace (sections, line,
+                              g_bytes_new_take (g_strndup (nl + 1, size), size));
+
+		p = nl + 1 + size + 1;
+	}
+
+	return sections;
+}
+
+/* The product uuid, or else the MAC address of the first network
+ * device. */
+static void
+system_machine_id_update (SysinfoWindow *window)
+{
+	gchar *product_uuid = NULL;
+	GVariant *reply = NULL;
+	GBytes *probed = NULL;
+	SysinfoWindowPrivate *priv = window->priv;
+
+	if (priv->probe)
+		probed = g_hash_table_lookup (priv->probe, "product-uuid");
+
+	if (probed) {
+		gchar **lines = g_strsplit (g_bytes_get_data (probed, NULL), "\n", -1);
+		if (g_strv_length (lines) > 0)
+			product_uuid = g_strdup (lines[0]);
+		g_strfreev (lines);
+	} else if ((reply = security_status_helper_call_sync ("GetProductUuid", NULL, NULL))) {
+		g_variant_get (reply, "(s)", &product_uuid);
+		g_variant_unref (reply);
+	} else {
+		gchar *pkexec, *cmdline, *output = NULL;
+
+		pkexec = g_find_program_in_path ("pkexec");
+		cmdline = g_strdup_printf ("%s %s", pkexec, GOOROOM_PRODUCT_UUID_HELPER);
+
+		if (g_spawn_command_line_sync (cmdline, &output, NULL, NULL, NULL)) {
+			gchar **lines = g_strsplit (output, "\n", -1);
+			if (g_strv_length (lines) > 0)
+				product_uuid = g_strdup (lines[0]);
+			g_strfreev (lines);
+		}
+
+		g_free (output);
+		g_free (pkexec);
+		g_free (cmdline);
+	}
+
+	if (product_uuid && g_strcmp0 (product_uuid, "") != 0) {
+		gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), product_uuid);
+		g_free (product_uuid);
+	} else {
+		/* Machine ID */
+		gchar *net_device = NULL;
+		const gchar *dirname = "/sys/class/net";
+
+		GDir *gdir = g_dir_open (dirname, 0, NULL);
+		if (gdir) {
+			const gchar *entry;
+			GList *l = NULL, *files = NULL;
+			while ((entry = g_dir_read_name (gdir))) {
+				files = g_list_insert_sorted (files, g_strdup (entry), str_compare_func);
+			}
+			g_dir_close (gdir);
 
-	g_file_get_contents (GOOROOM_SECURITY_LOGPARSER_NEXT_SEEKTIME, &seektime, NULL, NULL);
+			for (l = files; l != NULL; l = l->next) {
+				gchar *entry = (gchar *)l->data;
+				if (g_strcmp0 (entry, "lo") != 0) {
+					net_device = g_strdup (entry);
+					break;
+				}
+			}
+			g_list_free_full (files, g_free);
+		}
 
-	if (!run_security_log_parser_async (seektime, security_logparser_async_done, window)) {
-		if (gtk_widget_get_visible (priv->btn_safety_measure))
-			gtk_widget_set_sensitive (priv->btn_safety_measure, FALSE);
+		if (net_device) {
+			gchar *output = NULL;
+			gchar *path = g_strdup_printf ("%s/%s/address", dirname, net_device);
+			g_file_get_contents (path, &output, NULL, NULL);
+			if (output) {
+				guint i = 0;
+				gchar **lines = g_strsplit (output, "\n", -1);
+				for (i = 0; lines[i] != NULL; i++) {
+					if (lines[i] != NULL) {
+						gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), lines[i]);
+						break;
+					}
+				}
+				g_strfreev (lines);
+			}
+			g_free (output);
+			g_free (path);
+		} else {
+			gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), _("Unknown"));
+		}
 
-		gchar *markup = g_markup_printf_escaped ("<b><i>%s</i></b>", _("Unknown"));
-		gtk_label_set_markup (GTK_LABEL (priv->lbl_sec_status), markup);
-		g_free (markup);
+		g_free (net_device);
 	}
-
-	return FALSE;
 }
 
 static void
@@ -1475,78 +1905,6 @@ system_basic_info_update (SysinfoWindow *window)
 	}
 
 
-	/* product uuid */
-	{
-		gchar *product_uuid = NULL;
-		gchar *pkexec, *cmdline, *output = NULL;
-
-		pkexec = g_find_program_in_path ("pkexec");
-		cmdline = g_strdup_printf ("%s %s", pkexec, GOOROOM_PRODUCT_UUID_HELPER);
-
-		if (g_spawn_command_line_sync (cmdline, &output, NULL, NULL, NULL)) {
-			gchar **lines = g_strsplit (output, "\n", -1);
-			if (g_strv_length (lines) > 0)
-				product_uuid = g_strdup (lines[0]);
-			g_strfreev (lines);
-		}
-
-		g_free (output);
-		g_free (pkexec);
-		g_free (cmdline);
-
-		if (product_uuid && g_strcmp0 (product_uuid, "") != 0) {
-			gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), product_uuid);
-			g_free (product_uuid);
-		} else {
-			/* Machine ID */
-			gchar *net_device = NULL;
-			const gchar *dirname = "/sys/class/net";
-
-			GDir *gdir = g_dir_open (dirname, 0, NULL);
-			if (gdir) {
-				const gchar *entry;
-				GList *l = NULL, *files = NULL;
-				while ((entry = g_dir_read_name (gdir))) {
-					files = g_list_insert_sorted (files, g_strdup (entry), str_compare_func);
-				}
-				g_dir_close (gdir);
-
-				for (l = files; l != NULL; l = l->next) {
-					gchar *entry = (gchar *)l->data;
-					if (g_strcmp0 (entry, "lo") != 0) {
-						net_device = g_strdup (entry);
-						break;
-					}
-				}
-				g_list_free_full (files, g_free);
-			}
-
-			if (net_device) {
-				gchar *output = NULL;
-				gchar *path = g_strdup_printf ("%s/%s/address", dirname, net_device);
-				g_file_get_contents (path, &output, NULL, NULL);
-				if (output) {
-					guint i = 0;
-					gchar **lines = g_strsplit (output, "\n", -1);
-					for (i = 0; lines[i] != NULL; i++) {
-						if (lines[i] != NULL) {
-							gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), lines[i]);
-							break;
-						}
-					}
-					g_strfreev (lines);
-				}
-				g_free (output);
-				g_free (path);
-			} else {
-				gtk_label_set_text (GTK_LABEL (priv->lbl_machine_id), _("Unknown"));
-			}
-
-			g_free (net_device);
-		}
-	}
-
-
 	/* Set Operation Mode */
 	{
 		if (priv->standalone_mode) {
@@ -1593,108 +1951,183 @@ system_basic_info_update (SysinfoWindow *window)
 	gtk_label_set_text (GTK_LABEL (priv->lbl_conn_status), _("Unknown"));
 
 	/* Agent Connection Status */
-	agent_connection_status_check (window);
+	agent_heartbeat_send (window);
 
 	/* check update pacakges */
 	package_updating_check (window);
 
-	/* execute iptables or ip6tables command */
-	system_firewall_check (window);
+	package_updating_watch (window);
+}
+
+/* Turns the pending log entries into rows.  Many rows are loaded with
+ * the view detached, so it takes them in one model swap instead of a
+ * row_inserted each; the model keeps its own order, nothing re-sorts. */
+static void
+security_log_view_flush (SysinfoWindow *window)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+	GtkTreeView *view = GTK_TREE_VIEW (priv->trv_security_log);
+
+	if (security_log_model_get_n_pending (priv->log_model) < SECURITY_LOG_DETACH_MIN) {
+		security_log_model_flush (priv->log_model);
+		return;
+	}
 
-	priv->agent_check_timeout_id = g_timeout_add (AGENT_CONNECTION_STATUS_CHECK_TIMEOUT, (GSourceFunc) agent_connection_status_check_continually, window);
-	priv->update_check_timeout_id = g_timeout_add (UPDATE_PACKAGES_CHECK_TIMEOUT, (GSourceFunc) package_updating_check_continually, window);
+	gtk_tree_view_set_model (view, NULL);
+	security_log_model_flush (priv->log_model);
+	gtk_tree_view_set_model (view, GTK_TREE_MODEL (priv->log_model));
 }
 
-static gboolean
-security_log_get (GIOChannel   *source,
-                  GIOCondition  condition,
-                  gpointer      data)
+/* The categories come one after another, each over the whole range, so
+ * entries are only merged once a large batch is pending. */
+static void
+security_log_flush_cb (gpointer data)
 {
-	gchar  buff[1024] = {0, };
-	gsize  bytes_read;
+	SecurityLogFetch *fetch = data;
 
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
-	SysinfoWindowPrivate *priv = window->priv;
+	if (security_log_model_get_n_pending (fetch->window->priv->log_model) >= SECURITY_LOG_FLUSH_BATCH)
+		security_log_view_flush (fetch->window);
+}
 
-	GString *outputs = g_string_new ("");
+static void
+security_log_get (gboolean complete, gpointer data)
+{
+	SecurityLogFetch *fetch = data;
+	SysinfoWindow *window = fetch->window;
+	SysinfoWindowPrivate *priv;
 
-	while (g_io_channel_read_chars (source, buff, sizeof (buff), &bytes_read, NULL) == G_IO_STATUS_NORMAL) {
-		outputs = g_string_append_len (outputs, buff, bytes_read);
+	if (g_cancellable_is_cancelled (fetch->cancellable)) {
+		security_log_fetch_free (fetch);
+		return;
 	}
 
-	if (!outputs->str || outputs->len <= 0) {
-		goto done;
+	priv = window->priv;
+	priv->log_fetch = NULL;
+
+	if (!complete) {
+		/* the cache range is unchanged, so the next update fetches
+		 * these entries again */
+		security_log_model_truncate (priv->log_model, fetch->first_entry);
+	} else {
+		security_log_view_flush (window);
+
+		if (priv->log_cache_from < 0) {
+			priv->log_cache_from = fetch->keep_from;
+		} else {
+			priv->log_cache_from = MIN (priv->log_cache_from, fetch->keep_from);
+		}
+		priv->log_cache_to = fetch->keep_to;
+
+		if (priv->log_index)
+			security_log_index_store (priv->log_index, priv->log_model,
+                                      fetch->first_entry, fetch->keep_from, fetch->keep_to);
 	}
 
-	gchar *json_output = strstr (outputs->str, "JSON-ANCHOR=");
-	if (json_output) {
-		gchar *json_string = json_output + strlen ("JSON-ANCHOR=");
-		enum json_tokener_error jerr = json_tokener_success;
-		json_object *root_obj = json_tokener_parse_verbose (json_string, &jerr);
-		if (jerr == json_tokener_success) {
-			json_object *os_obj = NULL, *exe_obj = NULL, *boot_obj = NULL, *media_obj = NULL, *agent_obj = NULL;
-			json_object_object_get_ex (root_obj, "os_log", &os_obj);
-			json_object_object_get_ex (root_obj, "exe_log", &exe_obj);
-			json_object_object_get_ex (root_obj, "boot_log", &boot_obj);
-			json_object_object_get_ex (root_obj, "media_log", &media_obj);
-			json_object_object_get_ex (root_obj, "agent_log", &agent_obj);
+	security_log_fetch_free (fetch);
 
-			GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (priv->trv_security_log));
-			gtk_list_store_clear (GTK_LIST_STORE (model));
+	gdk_window_set_cursor (gtk_widget_get_window (GTK_WIDGET (window)), NULL);
+}
 
-			guint i = 0;
-			GList *filters = NULL;
-			guint log_filter = 0;
-			if (priv->settings)
-				log_filter = g_settings_get_uint (priv->settings, "log-filter");
-
-			for (i = 0; LOG_DATA[i].level != 0; i++) {
-				if (log_filter & LOG_DATA[i].level) {
-					filters = g_list_append (filters, g_strdup (LOG_DATA[i].type));
-				}
-			}
+/* Moves the indexed entries of the search range that the store lacks into
+ * it.  The store then only grows to the index's high-water mark, so the
+ * parser is asked for nothing the index already holds. */
+static void
+security_log_index_preload (SysinfoWindow *window)
+{
+	gint64 index_from, index_to, from, to;
+	SysinfoWindowPrivate *priv = window->priv;
 
-			show_log (priv->trv_security_log, os_obj, priv->search_to_utime, filters);
-			show_log (priv->trv_security_log, exe_obj, priv->search_to_utime, filters);
-			show_log (priv->trv_security_log, boot_obj, priv->search_to_utime, filters);
-			show_log (priv->trv_security_log, media_obj, priv->search_to_utime, filters);
-			show_log (priv->trv_security_log, agent_obj, priv->search_to_utime, filters);
+	if (!priv->log_index ||
+        !security_log_index_get_range (priv->log_index, &index_from, &index_to))
+		return;
 
-			g_list_free_full (filters, g_free);
+	from = CLAMP (priv->search_from_utime, index_from, index_to);
 
-			json_object_put (root_obj);
-		}
+	if (priv->log_cache_from < 0) {
+		to = index_to;
+	} else if (from < priv->log_cache_from) {
+		to = priv->log_cache_from;
+	} else {
+		return;
 	}
 
-done:
-	g_string_free (outputs, TRUE);
+	/* a running fetch would take these rows with it when cancelled */
+	security_log_fetch_cancel (window);
 
-	gtk_widget_set_sensitive (GTK_WIDGET (priv->btn_search), TRUE);
-	gdk_window_set_cursor (gtk_widget_get_window (GTK_WIDGET (window)), NULL);
+	security_log_index_load (priv->log_index, priv->log_model, from, to);
+	security_log_view_flush (window);
 
-	return FALSE;
+	if (priv->log_cache_from < 0)
+		priv->log_cache_to = index_to;
+	priv->log_cache_from = from;
 }
 
+static const SecurityLogParserFuncs security_log_parser_funcs = {
+	security_log_entry_cb,
+	NULL,
+	security_log_flush_cb,
+	security_log_get
+};
+
+/* Rows already in the store are never fetched again: a range inside the
+ * cache only refilters, a range starting before it re-runs the parser from
+ * the new start (which also brings the tail up to date), and a range
+ * reaching past the cache fetches just the tail when @fetch_tail is set.
+ * A new fetch supersedes the one still running. */
 static void
-system_security_log_update (SysinfoWindow *window)
+system_security_log_update (SysinfoWindow *window, gboolean fetch_tail)
 {
+	gint64 seek_from;
 	SysinfoWindowPrivate *priv = window->priv;
 
+	security_log_model_set_filter (priv->log_model, priv->log_filter,
+                                   priv->search_from_utime, priv->search_to_utime);
+
+	security_log_index_preload (window);
+
+	if (priv->log_cache_from < 0 || priv->search_from_utime < priv->log_cache_from) {
+		seek_from = priv->search_from_utime;
+	} else if (fetch_tail && priv->search_to_utime >= priv->log_cache_to) {
+		seek_from = priv->log_cache_to;
+	} else {
+		return;
+	}
+
+	security_log_fetch_cancel (window);
+
 	GdkDisplay *display = gtk_widget_get_display (GTK_WIDGET (window));
 	GdkCursor *cursor   = gdk_cursor_new_for_display (display, GDK_WATCH);
 
 	gdk_window_set_cursor (gtk_widget_get_window (GTK_WIDGET (window)), cursor);
 
-	gtk_widget_set_sensitive (GTK_WIDGET (priv->btn_search), FALSE);
+	SecurityLogFetch *fetch = security_log_fetch_new (window, seek_from,
+                                                      g_get_real_time () / G_USEC_PER_SEC);
 
-	gchar *seektime = seek_time_get (window);
-	if (!run_security_log_parser_async (seektime, security_log_get, window)) {
-		gtk_widget_set_sensitive (GTK_WIDGET (priv->btn_search), TRUE);
+	gchar *seektime = seek_time_get (seek_from);
+	if (run_security_log_parser_async (seektime, &security_log_parser_funcs,
+                                       fetch->cancellable, fetch)) {
+		priv->log_fetch = fetch;
+	} else {
+		security_log_fetch_free (fetch);
 		gdk_window_set_cursor (gtk_widget_get_window (GTK_WIDGET (window)), NULL);
 	}
 	g_free (seektime);
 }
 
+static void
+pkgs_change_blocking_state_cb (SysinfoWindow *window, gint ret)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+
+	if (ret == 1) {
+		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Enabled"));
+	} else if (ret == -1) {
+		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Disabled"));
+	} else {
+		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Unknown"));
+	}
+}
+
 static void
 system_device_security_update (SysinfoWindow *window)
 {
@@ -1741,14 +2174,8 @@ system_device_security_update (SysinfoWindow *window)
 	}
 
 	/* check function to stop changing packages */
-	gint ret = check_function_from_agent (window, "tell_update_operation");
-	if (ret == 1) {
-		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Enabled"));
-	} else if (ret == -1) {
-		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Disabled"));
-	} else {
-		gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Unknown"));
-	}
+	gtk_label_set_text (GTK_LABEL (priv->lbl_pkgs_change_blocking), _("Unknown"));
+	check_function_from_agent (window, "tell_update_operation", pkgs_change_blocking_state_cb);
 }
 
 static void
@@ -1981,16 +2408,13 @@ error:
 }
 
 static void
-system_push_update_update (gpointer data)
+push_update_state_cb (SysinfoWindow *window, gint ret)
 {
 	gboolean allow_push_update = FALSE;
 	gboolean sensitive_swt_push_update = TRUE;
 
-	SysinfoWindow *window = SYSINFO_WINDOW (data);
 	SysinfoWindowPrivate *priv = window->priv;
 
-	gint ret = check_function_from_agent (window, "get_package_operation");
-
 	if (ret == -1) {
 		allow_push_update = FALSE;
 	} else if (ret == 1) {
@@ -2006,16 +2430,24 @@ system_push_update_update (gpointer data)
 	gtk_widget_set_sensitive (priv->swt_push_update, sensitive_swt_push_update);
 }
 
+static void
+system_push_update_update (gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+
+	/* stays insensitive until the agent has answered */
+	gtk_widget_set_sensitive (window->priv->swt_push_update, FALSE);
+
+	check_function_from_agent (window, "get_package_operation", push_update_state_cb);
+}
+
 static gboolean
 system_push_update_set_cb (gpointer data)
 {
 	SysinfoWindow *window = SYSINFO_WINDOW (data);
-	SysinfoWindowPrivate *priv = window->priv;
 
 	system_push_update_update (window);
 
-	gtk_widget_set_sensitive (priv->swt_push_update, TRUE);
-
 	return FALSE;
 }
 
@@ -2061,34 +2493,18 @@ system_push_update_allow_or_deny (gpointer data)
 	if (response == GTK_RESPONSE_YES) {
 		gtk_widget_set_sensitive (priv->swt_push_update, FALSE);
 
-		GVariant   *variant;
-		GDBusProxy *proxy;
-
-		proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-				G_DBUS_CALL_FLAGS_NONE,
-				NULL,
-				"kr.gooroom.agent",
-				"/kr/gooroom/agent",
-				"kr.gooroom.agent",
-				NULL,
-				NULL);
+		json_object *in_obj, *out_obj;
 
-		if (proxy) {
-			const gchar *op = active ? "enable" : "disable";
-			const gchar *json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"set_package_operation\",\"in\":{\"operation\":\"%s\"}}}}";
+		in_obj = json_object_new_object ();
+		json_object_object_add (in_obj, "operation",
+                                json_object_new_string (active ? "enable" : "disable"));
 
-			gchar *arg = g_strdup_printf (json, op);
+		out_obj = agent_do_task_sync ("config", "set_package_operation", in_obj,
+                                      GOOROOM_AGENT_TASK_TIMEOUT, NULL);
+		if (out_obj)
+			json_object_put (out_obj);
 
-			variant = g_dbus_proxy_call_sync (proxy, "do_task",
-					g_variant_new ("(s)", arg),
-					G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
-
-			g_free (arg);
-
-			if (variant) {
-				g_variant_unref (variant);
-			}
-		}
+		json_object_put (in_obj);
 	}
 
 	g_idle_add ((GSourceFunc) system_push_update_set_cb, window);
@@ -2104,13 +2520,148 @@ on_push_update_changed (GtkSwitch *widget, gboolean state, gpointer data)
 	return FALSE;
 }
 
+/* Gathers every root-only fact the startup view needs with a single
+ * authorization instead of one pkexec per fact. */
+typedef struct {
+	SysinfoWindow *window;
+	GCancellable  *cancellable;
+} PrivilegedProbe;
+
+static void
+privileged_probe_free (PrivilegedProbe *probe)
+{
+	g_object_unref (probe->cancellable);
+	g_free (probe);
+}
+
+/* Shows what needs root, taking it from @sections where the probe got
+ * it; each consumer falls back to asking on its own. */
+static void
+privileged_probe_apply (SysinfoWindow *window, GHashTable *sections)
+{
+	SysinfoWindowPrivate *priv = window->priv;
+
+	priv->probe = sections;
+	priv->probe_running = FALSE;
+	if (priv->probe) {
+		GBytes *vulnerable = g_hash_table_lookup (priv->probe, "vulnerable");
+		if (vulnerable)
+			priv->probe_vulnerable = last_vulnerable_parse (g_bytes_get_data (vulnerable, NULL));
+	}
+
+	if (priv->status_waiting) {
+		priv->status_waiting = FALSE;
+		security_status_show (window);
+	}
+
+	system_machine_id_update (window);
+
+	/* execute iptables or ip6tables command */
+	system_firewall_check (window);
+
+	g_clear_pointer (&priv->probe, g_hash_table_destroy);
+}
+
+static void
+privileged_probe_done_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	GBytes *output;
+	GError *error = NULL;
+	GHashTable *sections = NULL;
+	PrivilegedProbe *probe = data;
+
+	output = command_runner_finish (res, NULL, &error);
+	if (!output && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		privileged_probe_free (probe);
+		return;
+	}
+
+	if (output) {
+		gsize len;
+		const gchar *text = g_bytes_get_data (output, &len);
+
+		if (text)
+			sections = privileged_probe_parse (text, len);
+		g_bytes_unref (output);
+	}
+
+	g_clear_error (&error);
+
+	privileged_probe_apply (probe->window, sections);
+	privileged_probe_free (probe);
+}
+
+static void
+privileged_probe_spawn (PrivilegedProbe *probe)
+{
+	CommandRunnerOptions options = { 0, };
+	const gchar *argv[] = { "pkexec", GOOROOM_SECURITY_STATUS_PROBE, NULL };
+
+	options.timeout = PRIVILEGED_PROBE_TIMEOUT;
+	options.keep_output = TRUE;
+
+	command_runner_spawn_async (argv, &options, probe->cancellable,
+                                privileged_probe_done_cb, probe);
+}
+
+static void
+privileged_probe_helper_cb (GObject *source, GAsyncResult *res, gpointer data)
+{
+	gint fd = -1;
+	GVariant *reply;
+	GError *error = NULL;
+	PrivilegedProbe *probe = data;
+
+	reply = security_status_helper_call_finish (res, &fd, &error);
+	if (!reply) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			privileged_probe_free (probe);
+		else
+			privileged_probe_spawn (probe);
+		g_clear_error (&error);
+		return;
+	}
+
+	g_variant_unref (reply);
+
+	if (fd >= 0) {
+		CommandRunnerOptions options = { 0, };
+
+		options.timeout = PRIVILEGED_PROBE_TIMEOUT;
+		options.keep_output = TRUE;
+
+		command_runner_read_fd_async (fd, &options, probe->cancellable,
+                                      privileged_probe_done_cb, probe);
+	} else {
+		privileged_probe_apply (probe->window, NULL);
+		privileged_probe_free (probe);
+	}
+}
+
+static void
+privileged_probe_run (SysinfoWindow *window)
+{
+	PrivilegedProbe *probe;
+
+	probe = g_new0 (PrivilegedProbe, 1);
+	probe->window = window;
+	probe->cancellable = g_object_ref (window->priv->cancellable);
+
+	window->priv->probe_running = TRUE;
+
+	if (!security_status_helper_call ("Probe", NULL, PRIVILEGED_PROBE_TIMEOUT * 1000,
+                                      probe->cancellable, privileged_probe_helper_cb, probe))
+		privileged_probe_spawn (probe);
+}
+
 static gboolean
 update_ui (gpointer data)
 {
 	SysinfoWindow *window = SYSINFO_WINDOW (data);
-	SysinfoWindowPrivate *priv = window->priv;
 
-	security_status_update_idle (window);
+	/* the facts needing root follow when the probe is done */
+	privileged_probe_run (window);
 
 	system_basic_info_update (window);
 	system_device_security_update (window);
@@ -2119,7 +2670,9 @@ update_ui (gpointer data)
 	system_resource_control_update (window);
 	system_browser_policy_update (window);
 
-	system_security_log_update (window);
+	/* started before the log page so both share one parser run */
+	security_status_update_idle (window);
+	system_security_log_update (window, TRUE);
 
 	return FALSE;
 }
@@ -2191,7 +2744,17 @@ update_security_log (gpointer data)
 {
 	SysinfoWindow *window = SYSINFO_WINDOW (data);
 
-	system_security_log_update (window);
+	system_security_log_update (window, TRUE);
+
+	return FALSE;
+}
+
+static gboolean
+show_cached_security_log (gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+
+	system_security_log_update (window, FALSE);
 
 	return FALSE;
 }
@@ -2217,11 +2780,23 @@ static void
 last_vulnerable_update (guint vulnerable)
 {
 	gchar *pkexec = NULL, *cmd = NULL;
+	GVariant *reply;
+
+	reply = security_status_helper_call_sync ("RecordVulnerable",
+                                              g_variant_new ("(u)", vulnerable),
+                                              NULL);
+	if (reply) {
+		g_variant_unref (reply);
+		return;
+	}
 
 	pkexec = g_find_program_in_path ("pkexec");
 	cmd = g_strdup_printf ("%s %s %u", pkexec, GOOROOM_SECURITY_STATUS_VULNERABLE_HELPER, vulnerable);
 
 	g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
+
+	g_free (pkexec);
+	g_free (cmd);
 }
 
 static void
@@ -2337,6 +2912,15 @@ popover_calendar (GtkToggleButton *button, gpointer data)
 	gtk_popover_popup (GTK_POPOVER (priv->calendar_popover));
 }
 
+static void
+log_search_changed_cb (GtkSearchEntry *entry, gpointer data)
+{
+	SysinfoWindow *window = SYSINFO_WINDOW (data);
+	SysinfoWindowPrivate *priv = window->priv;
+
+	security_log_model_set_search (priv->log_model, gtk_entry_get_text (GTK_ENTRY (entry)));
+}
+
 static void
 logfilter_popover_closed_cb (GtkPopover *popover, gpointer data)
 {
@@ -2358,8 +2942,12 @@ logfilter_popover_closed_cb (GtkPopover *popover, gpointer data)
 	if (priv->settings)
 		g_settings_set_uint (priv->settings, "log-filter", new_log_filter);
 
-	if (priv->prev_log_filter != new_log_filter)
-		g_timeout_add (100, (GSourceFunc) update_security_log, data);
+	/* the last result set holds every level, so only the filter changes */
+	if (priv->prev_log_filter != new_log_filter) {
+		priv->log_filter = new_log_filter;
+		security_log_model_set_filter (priv->log_model, priv->log_filter,
+                                       priv->search_from_utime, priv->search_to_utime);
+	}
 }
 
 static void
@@ -2419,7 +3007,7 @@ on_stack_visible_child_notify_cb (GObject    *object,
 	const gchar *name = gtk_stack_get_visible_child_name (GTK_STACK (object));
 
 	if (g_str_equal (name, "log-page"))
-		g_timeout_add (100, (GSourceFunc) update_security_log, data);
+		g_timeout_add (100, (GSourceFunc) show_cached_security_log, data);
 }
 
 static void
@@ -2438,6 +3026,7 @@ file_status_changed_cb (GFileMonitor      *monitor,
 		case G_FILE_MONITOR_EVENT_DELETED:
 		case G_FILE_MONITOR_EVENT_CREATED:
 		{
+			priv->probe_vulnerable = -1;
 			g_timeout_add (100, (GSourceFunc) security_status_update_idle, window);
 			break;
 		}
@@ -2470,8 +3059,24 @@ sysinfo_window_init (SysinfoWindow *self)
 	priv->security_status = SECURITY_STATUS_UNKNOWN;
 	priv->standalone_mode = TRUE;
 	priv->agent_check_timeout_id = 0;
+	priv->agent_heartbeat_failures = 0;
+	priv->agent_heartbeat_in_flight = FALSE;
+	priv->hidden = FALSE;
 	priv->update_check_timeout_id = 0;
+	priv->update_check_debounce_id = 0;
+	priv->update_monitors = NULL;
+	priv->firewall_check_timeout_id = 0;
+	priv->firewall_fingerprint4 = NULL;
+	priv->firewall_fingerprint6 = NULL;
 	priv->prev_log_filter = 0;
+	priv->log_filter = 0;
+	priv->log_cache_from = -1;
+	priv->log_cache_to = -1;
+	priv->probe = NULL;
+	priv->probe_vulnerable = -1;
+	priv->probe_running = FALSE;
+	priv->status_waiting = FALSE;
+	priv->cancellable = g_cancellable_new ();
     priv->settings = NULL;
 
 	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
@@ -2479,8 +3084,16 @@ sysinfo_window_init (SysinfoWindow *self)
 	if (schema) {
 		priv->settings = g_settings_new_full (schema, NULL, NULL);
 		g_settings_schema_unref (schema);
+
+		priv->log_filter = g_settings_get_uint (priv->settings, "log-filter");
+
+		g_signal_connect (priv->settings, "changed",
+                          G_CALLBACK (agent_heartbeat_settings_changed_cb), self);
 	}
 
+	g_signal_connect (G_OBJECT (self), "window-state-event",
+                      G_CALLBACK (on_window_state_event), NULL);
+
 	file = g_file_new_for_path (GOOROOM_SECURITY_STATUS_VULNERABLE);
 
 	monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
@@ -2528,8 +3141,16 @@ sysinfo_window_init (SysinfoWindow *self)
 
     accel_init (self);
 
-	GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (priv->trv_security_log));
-	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (GTK_LIST_STORE (model)), 4, GTK_SORT_DESCENDING);
+	priv->log_model = security_log_model_new ();
+
+	priv->firewall_model4 = firewall_rule_model_new ();
+	priv->firewall_model6 = firewall_rule_model_new ();
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->trv_firewall4), GTK_TREE_MODEL (priv->firewall_model4));
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->trv_firewall6), GTK_TREE_MODEL (priv->firewall_model6));
+	priv->log_index = security_log_index_open ();
+	security_log_model_set_filter (priv->log_model, priv->log_filter,
+                                   priv->search_from_utime, priv->search_to_utime);
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->trv_security_log), GTK_TREE_MODEL (priv->log_model));
 
 	g_signal_connect (G_OBJECT (priv->stack), "notify::visible-child", G_CALLBACK (on_stack_visible_child_notify_cb), self);
 
@@ -2559,6 +3180,14 @@ sysinfo_window_init (SysinfoWindow *self)
 	g_signal_connect (G_OBJECT (priv->btn_calendar_to), "toggled", G_CALLBACK (btn_calendar_to_clicked_cb), self);
 	g_signal_connect (G_OBJECT (priv->btn_search), "clicked", G_CALLBACK (btn_search_clicked_cb), self);
 	g_signal_connect (G_OBJECT (priv->btn_log_filter), "toggled", G_CALLBACK (log_filter_clicked_cb), self);
+	g_signal_connect (G_OBJECT (priv->ent_log_search), "search-changed", G_CALLBACK (log_search_changed_cb), self);
+
+	g_signal_connect (G_OBJECT (priv->cmb_firewall4_chain), "changed", G_CALLBACK (firewall_filter_changed_cb), self);
+	g_signal_connect (G_OBJECT (priv->cmb_firewall4_target), "changed", G_CALLBACK (firewall_filter_changed_cb), self);
+	g_signal_connect (G_OBJECT (priv->ent_firewall4_search), "search-changed", G_CALLBACK (firewall_filter_changed_cb), self);
+	g_signal_connect (G_OBJECT (priv->cmb_firewall6_chain), "changed", G_CALLBACK (firewall_filter_changed_cb), self);
+	g_signal_connect (G_OBJECT (priv->cmb_firewall6_target), "changed", G_CALLBACK (firewall_filter_changed_cb), self);
+	g_signal_connect (G_OBJECT (priv->ent_firewall6_search), "search-changed", G_CALLBACK (firewall_filter_changed_cb), self);
 
 	g_timeout_add (500, (GSourceFunc) update_ui, self);
 }
@@ -2579,7 +3208,37 @@ sysinfo_window_finalize (GObject *object)
 		priv->update_check_timeout_id = 0;
 	}
 
+	if (priv->update_check_debounce_id != 0) {
+		g_source_remove (priv->update_check_debounce_id);
+		priv->update_check_debounce_id = 0;
+	}
+
+	GList *l;
+	for (l = priv->update_monitors; l; l = l->next) {
+		g_signal_handlers_disconnect_by_data (l->data, window);
+		g_file_monitor_cancel (G_FILE_MONITOR (l->data));
+	}
+	g_list_free_full (priv->update_monitors, g_object_unref);
+	priv->update_monitors = NULL;
+
+	if (priv->firewall_check_timeout_id != 0) {
+		g_source_remove (priv->firewall_check_timeout_id);
+		priv->firewall_check_timeout_id = 0;
+	}
+
+	g_clear_pointer (&priv->firewall_fingerprint4, g_free);
+	g_clear_pointer (&priv->firewall_fingerprint6, g_free);
+
+	security_log_fetch_cancel (window);
+
+	g_cancellable_cancel (priv->cancellable);
+	g_clear_object (&priv->cancellable);
+
 	g_object_unref (priv->settings);
+	g_clear_object (&priv->log_model);
+	g_clear_object (&priv->firewall_model4);
+	g_clear_object (&priv->firewall_model6);
+	g_clear_pointer (&priv->log_index, security_log_index_free);
 
 	G_OBJECT_CLASS (sysinfo_window_parent_class)->finalize (object);
 }
@@ -2609,10 +3268,18 @@ sysinfo_window_class_init (SysinfoWindowClass *class)
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_firewall4_policy);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, scl_firewall4);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, trv_firewall4);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, box_firewall4_filter);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, cmb_firewall4_chain);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, cmb_firewall4_target);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, ent_firewall4_search);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_firewall6);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_firewall6_policy);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, scl_firewall6);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, trv_firewall6);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, box_firewall6_filter);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, cmb_firewall6_chain);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, cmb_firewall6_target);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, ent_firewall6_search);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, trv_security_log);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_sec_status);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_device_id);
@@ -2656,6 +3323,7 @@ sysinfo_window_class_init (SysinfoWindowClass *class)
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_search_date_from);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, lbl_search_date_to);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, btn_log_filter);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (class), SysinfoWindow, ent_log_search);
 }
 
 SysinfoWindow*